@@ -6,6 +6,445 @@
 /// @version 0.0.0
 /// @date 2015-12-20
 
+#include <pragmas.h>        // setting standard pragmas
+#include <privs.h>          // privlege related defines
+#include <std_paths.h>      // standard paths used by various objects
+
+#define SAVE_FILE   PRIV_SAVE_DIR "mud_info"
+
+/// @brief groups
+///
+/// data format:
+/// ([
+///    "uid" : ({ UPRIV_*, ... }),
+///     ...
+/// ])
+private mapping groups;
+
+/// @brief domains
+///
+/// data format:
+/// ([
+///    "domain" : ([
+///                   "members" : ({ "uid", ... }),
+///                   "lords"   : ({ "uid", ... }),
+///               ]),
+///     ...
+/// ])
+private mapping domains;
+
+private nosave mapping upriv_bits;      ///< UPRIV_* -> bit index
+
+/// @brief member_of, lord_of
+///
+/// reverse index of domains, rebuilt on load and kept current by
+/// add_domain_member/remove_domain_member:
+/// ([
+///    "uid" : ([ "domain" : 1, ... ]),
+///     ...
+/// ])
+private nosave mapping member_of,       ///< domains uid is member of
+                       lord_of;         ///< domains uid is lord of
+
+/// @brief known_dirs
+///
+/// Directories on those levels where ownership depends on whether a path is
+/// a directory (see author_file), kept current by sefun::mkdir/rmdir so no
+/// stat is needed to answer author_file/domain_file:
+/// ([ "/players/w/wiz": 1, ... ])
+private nosave mapping known_dirs;
+
+private int     is_dir(string path);
+private void    index_domain(string domain, string uid, int add);
+private void    membership_changed(string uid);
+private int     privileged_caller(string func);
+public  string *get_groups(string uid);
+public  mixed  *query_upriv_mask(string uid);
+public  void    rescan_dirs(void);
+
+void create()
+{
+    upriv_bits = UPRIV_BIT_MAP;
+
+    restore_object(SAVE_FILE);
+    if(!groups)
+        groups = ([]);
+    if(!domains)
+        domains = ([]);
+
+    member_of = ([]);
+    lord_of   = ([]);
+    foreach(string domain, mapping entry in domains)
+    {
+        foreach(string uid in entry["members"])
+            index_domain(domain, uid, TRUE);
+        foreach(string uid in entry["lords"])
+        {
+            if(!lord_of[uid])
+                lord_of[uid] = ([]);
+            lord_of[uid][domain] = 1;
+        }
+    }
+
+    // the master may have been loaded before us
+    foreach(string uid, string *grps in groups)
+        master()->set_member_groups(uid, grps);
+
+    rescan_dirs();
+}
+
+int clean_up(int arg)
+{
+    return 0;
+}
+
+// helper functions
+// --------------------------------------------------------------------------
+/// @brief privileged_caller
+/// @Param func - name of the guarded function (for logging)
+/// @Returns TRUE if the calling object has effective root privileges
+// --------------------------------------------------------------------------
+private int privileged_caller(string func)
+{
+    object po = PO();
+
+    if(geteuid(po) == ROOT_UID)
+        return TRUE;
+
+    syslog(LOG_AUTH|LOG_ERR, "Privilege violation: mud_info::%s by %O[%s]",
+            func, po, efun::geteuid(po));
+    return FALSE;
+}
+// --------------------------------------------------------------------------
+/// @brief membership_changed
+///
+/// saves the new memberships and pushes the groups and resulting UPRIV_* mask
+/// of uid to the master, cached access decisions depending on them are no longer valid.
+/// As domain_file depends on them too, memoized ownerships are dropped.
+/// @Param uid - whose memberships changed
+/// @Returns -
+// --------------------------------------------------------------------------
+private void membership_changed(string uid)
+{
+    mixed *mask;
+
+    save_object(SAVE_FILE);
+    flush_owner_cache();
+    master()->set_member_groups(uid, get_groups(uid));
+    mask = query_upriv_mask(uid);
+    master()->set_upriv_mask(uid, mask[0], mask[1]);
+}
+
+// --------------------------------------------------------------------------
+/// @brief index_domain
+///
+/// updates member_of/lord_of, removing a member drops lordship too
+/// @Param domain
+/// @Param uid
+/// @Param add - TRUE: add uid as member of domain, FALSE: remove uid from domain
+/// @Returns -
+// --------------------------------------------------------------------------
+private void index_domain(string domain, string uid, int add)
+{
+    if(add)
+    {
+        if(!member_of[uid])
+            member_of[uid] = ([]);
+        member_of[uid][domain] = 1;
+        return;
+    }
+    if(member_of[uid])
+    {
+        map_delete(member_of[uid], domain);
+        if(!sizeof(member_of[uid]))
+            map_delete(member_of, uid);
+    }
+    if(lord_of[uid])
+    {
+        map_delete(lord_of[uid], domain);
+        if(!sizeof(lord_of[uid]))
+            map_delete(lord_of, uid);
+    }
+}
+// --------------------------------------------------------------------------
+/// @brief is_dir
+///
+/// same as (file_size(path) == -2) for the levels covered by known_dirs
+/// @Param path - absolute path
+/// @Returns TRUE if path is a directory
+// --------------------------------------------------------------------------
+private int is_dir(string path)
+{
+    return (path[<1] == '/') || known_dirs[path];
+}
+// --------------------------------------------------------------------------
+/// @brief scan_dirs
+/// @Param dir - directory to be scanned (ending in '/')
+/// @Returns sub directories of dir (without trailing '/')
+// --------------------------------------------------------------------------
+private string *scan_dirs(string dir)
+{
+    mixed *list = get_dir(dir, -1);
+
+    if(!list)
+        return ({});
+    return map(filter(list, (: $1[1] == -2 :)), (: $(dir) + $1[0] :));
+}
+
+// directory existence cache
+// --------------------------------------------------------------------------
+/// @brief rescan_dirs
+///
+/// (re)builds known_dirs, needed only if directories were created or removed
+/// outside of the mudlib
+/// @Returns -
+// --------------------------------------------------------------------------
+public void rescan_dirs(void)
+{
+    if(known_dirs && !privileged_caller("rescan_dirs"))
+        return;
+
+    known_dirs = ([ "/players": 1, "/Domains": 1 ]);
+
+    // ""/"players"/"w"/"wiz"
+    foreach(string letter in scan_dirs("/players/"))
+    {
+        known_dirs[letter] = 1;
+        foreach(string dir in scan_dirs(letter + "/"))
+            known_dirs[dir] = 1;
+    }
+    // ""/"Domains"/"Example"/"members"/"wiz"
+    foreach(string domain in scan_dirs("/Domains/"))
+    {
+        known_dirs[domain] = 1;
+        foreach(string dir in scan_dirs(domain + "/"))
+            known_dirs[dir] = 1;
+        foreach(string dir in scan_dirs(domain + "/members/"))
+            known_dirs[dir] = 1;
+    }
+
+    flush_owner_cache();
+}
+// --------------------------------------------------------------------------
+/// @brief dir_changed
+///
+/// called by sefun::mkdir/rmdir after a successful operation
+/// @Param dir - absolute path of created/removed directory
+/// @Param exists - TRUE if dir was created
+/// @Returns -
+// --------------------------------------------------------------------------
+public void dir_changed(string dir, int exists)
+{
+    string *path;
+    int     sp;
+
+    if(PO() != simul_efun())
+        return;
+
+    if(dir[<1] == '/')
+        dir = dir[0..<2];
+    path = explode(dir, "/");           // path[0] == "" !!!
+    sp   = sizeof(path);
+
+    // only the levels author_file/domain_file depend upon
+    if((sp < 3) || (sp > 5) ||
+        ((path[1] != "players") && (path[1] != "Domains")) ||
+        ((path[1] == "players") && (sp > 4)))
+        return;
+
+    if(exists)
+        known_dirs[dir] = 1;
+    else
+        map_delete(known_dirs, dir);
+
+    flush_owner_cache();
+    master()->invalidate_acl_cache();
+}
+
+// group and domain memberships
+// --------------------------------------------------------------------------
+/// @brief get_groups
+/// @Param uid
+/// @Returns groups (UPRIV_*) uid is member of
+// --------------------------------------------------------------------------
+public string *get_groups(string uid)
+{
+    return groups[uid] || ({});
+}
+// --------------------------------------------------------------------------
+/// @brief is_wiz
+/// @Param uid
+/// @Returns TRUE if uid is a wizard
+// --------------------------------------------------------------------------
+public int is_wiz(string uid)
+{
+    return member_array(UPRIV_WIZARD, get_groups(uid)) != -1;
+}
+// --------------------------------------------------------------------------
+/// @brief add_group
+/// @Param uid
+/// @Param group - one of UPRIV_*
+/// @Returns TRUE if uid was added to group
+// --------------------------------------------------------------------------
+public int add_group(string uid, string group)
+{
+    if(!privileged_caller("add_group"))
+        return FALSE;
+    if(member_array(group, get_groups(uid)) != -1)
+        return FALSE;
+
+    groups[uid] = get_groups(uid) + ({ group });
+    membership_changed(uid);
+    return TRUE;
+}
+// --------------------------------------------------------------------------
+/// @brief remove_group
+/// @Param uid
+/// @Param group - one of UPRIV_*
+/// @Returns TRUE if uid was removed from group
+// --------------------------------------------------------------------------
+public int remove_group(string uid, string group)
+{
+    if(!privileged_caller("remove_group"))
+        return FALSE;
+    if(member_array(group, get_groups(uid)) == -1)
+        return FALSE;
+
+    if(!sizeof(groups[uid] -= ({ group })))
+        map_delete(groups, uid);
+    membership_changed(uid);
+    return TRUE;
+}
+// --------------------------------------------------------------------------
+/// @brief query_upriv_mask
+///
+/// UPRIV_* granted to uid as interactive user, apart from elders only
+/// wizards are granted anything
+/// @Param uid
+/// @Returns ({ mask, ([ "domain" : mask, ... ]) })
+// --------------------------------------------------------------------------
+public mixed *query_upriv_mask(string uid)
+{
+    mapping dom  = ([]);
+    int     mask = 0;
+
+    foreach(string group in get_groups(uid))
+    {
+        if(!undefinedp(upriv_bits[group]))
+            mask |= UPRIV_MASK(upriv_bits[group]);
+    }
+    if(!(mask & UPRIV_MASK(UPRIV_B_WIZARD)))
+        return ({ mask & UPRIV_MASK(UPRIV_B_ELDER), dom });
+    mask &= UPRIV_MASK(UPRIV_B_ELDER) | UPRIV_MASK(UPRIV_B_WIZARD) |
+            UPRIV_MASK(UPRIV_B_ARCH)  | UPRIV_MASK(UPRIV_B_ADMIN);
+
+    foreach(string domain in keys(member_of[uid] || ([])))
+        dom[domain] = UPRIV_MASK(UPRIV_B_D_WIZ);
+    foreach(string domain in keys(lord_of[uid] || ([])))
+        dom[domain] |= UPRIV_MASK(UPRIV_B_D_LORD);
+    return ({ mask, dom });
+}
+// --------------------------------------------------------------------------
+/// @brief get_domains
+/// @Returns all known domains
+// --------------------------------------------------------------------------
+public string *get_domains(void)
+{
+    return keys(domains);
+}
+// --------------------------------------------------------------------------
+/// @brief get_domain_member
+/// @Param domain
+/// @Returns members of domain (lords included)
+// --------------------------------------------------------------------------
+public string *get_domain_member(string domain)
+{
+    return domains[domain] ? domains[domain]["members"] : ({});
+}
+// --------------------------------------------------------------------------
+/// @brief get_domain_lords
+/// @Param domain
+/// @Returns lords of domain
+// --------------------------------------------------------------------------
+public string *get_domain_lords(string domain)
+{
+    return domains[domain] ? domains[domain]["lords"] : ({});
+}
+// --------------------------------------------------------------------------
+/// @brief is_domain_member
+/// @Param uid
+/// @Param domain - "@any@" for membership in any domain
+/// @Returns TRUE if uid is member (or lord) of domain
+// --------------------------------------------------------------------------
+public int is_domain_member(string uid, string domain = "@any@")
+{
+    mapping dom = member_of[uid];
+
+    if(!dom)
+        return FALSE;
+    return (domain == "@any@") || dom[domain];
+}
+// --------------------------------------------------------------------------
+/// @brief is_domain_lord
+/// @Param uid
+/// @Param domain - "@any@" for lordship of any domain
+/// @Returns TRUE if uid is lord of domain
+// --------------------------------------------------------------------------
+public int is_domain_lord(string uid, string domain = "@any@")
+{
+    mapping dom = lord_of[uid];
+
+    if(!dom)
+        return FALSE;
+    return (domain == "@any@") || dom[domain];
+}
+// --------------------------------------------------------------------------
+/// @brief add_domain_member
+/// @Param domain - will be created if not yet known
+/// @Param uid
+/// @Param lord - TRUE if uid becomes lord of domain
+/// @Returns TRUE on success
+// --------------------------------------------------------------------------
+public int add_domain_member(string domain, string uid, int lord = FALSE)
+{
+    if(!privileged_caller("add_domain_member"))
+        return FALSE;
+
+    if(!domains[domain])
+        domains[domain] = ([ "members": ({}), "lords": ({}) ]);
+    domains[domain]["members"] = (domains[domain]["members"] - ({ uid })) + ({ uid });
+    index_domain(domain, uid, TRUE);
+    if(lord)
+    {
+        domains[domain]["lords"] = (domains[domain]["lords"] - ({ uid })) + ({ uid });
+        if(!lord_of[uid])
+            lord_of[uid] = ([]);
+        lord_of[uid][domain] = 1;
+    }
+    membership_changed(uid);
+    return TRUE;
+}
+// --------------------------------------------------------------------------
+/// @brief remove_domain_member
+/// @Param domain
+/// @Param uid
+/// @Returns TRUE if uid was member of domain
+// --------------------------------------------------------------------------
+public int remove_domain_member(string domain, string uid)
+{
+    if(!privileged_caller("remove_domain_member"))
+        return FALSE;
+    if(member_array(uid, get_domain_member(domain)) == -1)
+        return FALSE;
+
+    domains[domain]["members"] -= ({ uid });
+    domains[domain]["lords"]   -= ({ uid });
+    index_domain(domain, uid, FALSE);
+    membership_changed(uid);
+    return TRUE;
+}
+
+// mssp
 // --------------------------------------------------------------------------
 /// @brief mssp_telopt
 ///
@@ -148,43 +587,54 @@ string mssp_login()
 /// @brief author_file
 ///
 /// This is a helper function for sefun::author_of with the same semantics
-/// as master::author_file
+/// as master::author_file. Ownership depends on the shape of the path only,
+/// whether a path is a directory is looked up in known_dirs:
+///
+///     path                                author
+///     /players                 (dir)      BB_UID
+///     /players/w               (dir)      BB_UID
+///     /players/w/wiz           (dir)      wiz
+///     /players/w/wiz/...                  wiz
+///     /Domains                 (dir)      BB_UID
+///     /Domains/Example         (dir)      Example
+///     /Domains/Example/...                Example
+///     /Domains/Example/members/wiz (dir)  wiz
+///     /Domains/Example/members/wiz/...    wiz
+///     /var/spool/mail/p/player/...        player
+///     /var/spool/...                      BB_UID
+///     everything else                     UNKNOWN_UID
 /// @Param file - absolute path to source of some object
 /// @Returns name of author - for the security system this will be the uid
-/// @Todo this is a preliminary implementation without using any mud_info_d
-/// functionality
 // --------------------------------------------------------------------------
 public string author_file(string file)
 {
     string *path;
-    int     sp,
-            fs;
+    int     sp;
 
     path = explode(file, "/");          // path[0] == "" !!!
     sp   = sizeof(path);
-    fs   = file_size(file);
 
     switch(path[1])
     {
         case "players":                 // some player file
             // ""/"players"/"w"/"wiz"/"file.c"
             // 0  1         2   3     4
-            if((sp > 4) || (sp == 4) && (fs == -2))
+            if((sp > 4) || (sp == 4) && is_dir(file))
                 return path[3];         // file/directory is owned by some player
-            else if(fs == -2)
+            else if(is_dir(file))
                 return BB_UID;          // the other directories belong to backbone
             break;
         case "Domains":                 // file belongs to some domain
             // ""/"Domains"/"Example"/"members"/"wiz"/"file.c"
             // 0  1         2         3         4     5
             if(((sp >= 5) && (path[3] == "members")) &&
-                ((sp > 5) || ((sp == 5) && (fs == -2))))
+                ((sp > 5) || ((sp == 5) && is_dir(file))))
                 return path[4];         // but is owned by one of it's members
             // ""/"Domains"/"Example"/"file.c"
             // 0  1         2         3
-            else if((sp > 3) || ((sp == 3) && (fs == -2)))
+            else if((sp > 3) || ((sp == 3) && is_dir(file)))
                 return path[2];         // this file/directory truly belongs to the domain
-            else if(fs == -2)
+            else if(is_dir(file))
                 return BB_UID;          // the other directories belong to backbone
             break;
         case "var":                     // some special cases
@@ -204,39 +654,45 @@ public string author_file(string file)
 /// @brief domain_file
 ///
 /// This is a helper function for sefun::domain_of with the same semantics
-/// as master::domain_file
+/// as master::domain_file, see author_file for directory handling:
+///
+///     path                                domain
+///     /players                 (dir)      BB_DOMAIN
+///     /players/w               (dir)      BB_DOMAIN
+///     /players/w/wiz           (dir)      WIZARD_DOMAIN or PLAYER_DOMAIN
+///     /players/w/wiz/...                  WIZARD_DOMAIN or PLAYER_DOMAIN
+///     /Domains                            BB_DOMAIN
+///     /Domains/Example         (dir)      Example
+///     /Domains/Example/...                Example
+///     everything else                     UNKNOWN_DOMAIN
 /// @Param file
 /// @Returns domain the file belongs to - for the security system this will be
 /// the gid
-/// @Todo this is a preliminary implementation without using full mud_info_d
-/// functionality
 // --------------------------------------------------------------------------
 public string domain_file(string file)
 {
     string *path;
-    int     sp,
-            fs;
+    int     sp;
 
     path = explode(file, "/");      // path[0] == "" !!!
     sp   = sizeof(path);
-    fs   = file_size(file);
 
     switch(path[1])
     {
         case "players":                 // some player file
             // ""/"players"/"w"/"wiz"/"file.c"
             // 0  1         2   3     4
-            if((sp > 4) || (sp == 4) && (fs == -2))
+            if((sp > 4) || (sp == 4) && is_dir(file))
                 return (is_wiz(path[3])) ?
                         WIZARD_DOMAIN : // wizard
                         PLAYER_DOMAIN;  // mortal
-            else if(fs == -2)
+            else if(is_dir(file))
                 return BB_DOMAIN;       // the other directories belong to backbone
             break;
         case "Domains":                 // file belongs to some domain
             // ""/"Domains"/"Example"/"file.c"
             // 0  1         2         3
-            if((sp > 3) || ((sp == 3) && (fs == -2)))
+            if((sp > 3) || ((sp == 3) && is_dir(file)))
                 return path[2];         // this file truly belongs to the domain
             else if(sp == 2)
                 return BB_DOMAIN;       // the '/Domains' directory belongs to backbone
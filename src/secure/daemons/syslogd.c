@@ -11,19 +11,178 @@
 #include "/secure/include/pragmas.h"    // setting standard pragmas
 #include "/secure/include/std_defs.h"   // standard defines
 #include "/secure/include/std_paths.h"  // standard paths used by various objects
+#include "/secure/include/driver/localtime.h"   // LT_* for localtime()
 
 #define SAVE_FILE   PRIV_SAVE_DIR "syslogd"
 
+#define FLUSH_SIZE      4096        ///< a destination is written once this many bytes are buffered
+#define FLUSH_DELAY     2           ///< seconds a buffered message may wait at most
+#define BUFFER_MAX      65536       ///< max. bytes buffered over all destinations
+#define ASYNC_MAX       8           ///< max. # of async writes in flight
+#define ROTATE_SIZE     1048576     ///< default size a log file is rotated at
+#define ROTATE_KEEP     5           ///< default # of rotated files kept
+#define COMPRESS_DELAY  1           ///< seconds between two compression slices
+#define INDEX_STEP      65536       ///< bytes between two entries of a time index
+#define INDEX_REC       24          ///< size of an index entry ("%010d %012d\n")
+#define INDEX_SUFFIX    ".idx"      ///< time index of a structured log file
+#define QUERY_WINDOW    8192        ///< bytes read at once by query_log
+#define QUERY_LIMIT     1000        ///< default max. # of records returned by query_log
+#define QUERY_BUDGET    262144      ///< max. bytes read by a single query_log call
+#define PRE_INIT_MAX    1024        ///< max. # of messages queued before initialize
+#define STORM_WINDOW    60          ///< seconds identical messages are collapsed into one
+#define STORM_MAX       1024        ///< max. # of fingerprints tracked
+#define STORM_BODY      256         ///< # characters of a body used as fingerprint for a bare "%s"
+#define BUCKET_RATE     10          ///< messages per second a uid may log in the long run
+#define BUCKET_BURST    100         ///< messages a uid may log at once
+#define RECENT_SIZE     256         ///< # of entries kept by the flight recorder
+#define RECENT_DUMP     LOG_DIR "recent"    ///< flight recorder dumps go here
+#ifdef __PACKAGE_COMPRESS__
+#define ROTATE_SUFFIX   ".gz"       ///< rotated files are compressed
+#else
+#define ROTATE_SUFFIX   ""
+#endif
+
 nosave int      init_done;
+nosave mixed   *pre_init;       ///< ({ ({ uid, gid, priority, body, time }), ... }) logged before initialize
 nosave int     *co_handles;     ///< call_out_handles
 mapping         log_file_dict;  ///< dictionary: which facility from which user goes to which file?
+mapping         level_facility, ///< facility : least urgent level logged
+                level_uid;      ///< "uid" : least urgent level logged (precedes level_facility)
+mapping         rotate_size,    ///< "file" : size the file is rotated at (default ROTATE_SIZE)
+                rotate_keep;    ///< "file" : # of rotated files kept (default ROTATE_KEEP)
+
+/// @brief structured
+///
+/// log files written as structured records ([ "file" : 1, ... ]), one line
+/// per record:
+/// "tttttttttt ssssss YYYY-MM-DDThh:mm:ss+hhmm fff ll uid------------- gid------------- message\n"
+/// (time, sequence number, time as ISO-8601, facility, level >> LOG_SHIFT, uid
+/// and gid padded/cut to 16, newlines in message escaped). Every INDEX_STEP bytes a time index entry
+/// "tttttttttt oooooooooooo\n" (time, offset of record) is appended to
+/// file INDEX_SUFFIX. Rotated structured files aren't compressed, so they
+/// stay searchable by query_log.
+mapping         structured;
+
+/// @brief buffers
+///
+/// messages not yet written:
+/// ([
+///    "file" : ({ "msg", ... }),
+///     ...
+/// ])
+private nosave mapping  buffers;
+private nosave mapping  buf_sizes;      ///< "file" : # bytes buffered
+private nosave int      buffered,       ///< # bytes buffered over all destinations
+                        flush_handle,   ///< call_out handle of the pending flush, 0 if none
+                        dropped,        ///< # messages lost (buffer full or write failed)
+                        messages,       ///< # messages accepted
+                        writes;         ///< # write_file calls
 
+/// @brief in_flight
+///
+/// destinations with an async write in progress:
+/// ([ "file" : # messages being written, ... ])
+/// further messages for such a file stay buffered until the write completed,
+/// so the order within a file is kept
+private nosave mapping  in_flight;
+private nosave int      async_mode,     ///< write via async_write if available
+                        async_writes,   ///< # async_write calls
+                        async_errors,   ///< # failed async writes
+                        unconfirmed,    ///< # messages still in flight at shutdown
+                        sync_fallbacks; ///< # writes done synchronously as ASYNC_MAX was reached
+
+/// @brief file_sizes
+///
+/// current size of the log files written so far, tracked while writing so
+/// rotation doesn't need to stat:
+/// ([ "file" : # bytes, ... ])
+private nosave mapping  file_sizes;
+private nosave string  *compress_queue; ///< rotated files still to be compressed
+private nosave mapping  index_next;     ///< "file" : offset the next index entry is due at
+private nosave string  *level_names;    ///< LOG_* >> LOG_SHIFT -> name
+
+/// @brief stamp_*
+///
+/// time stamps are formatted at most once per second, entries within the same
+/// second are ordered by log_seq
+private nosave int      stamp_time,     ///< time stamp_ctime/stamp_iso belong to
+                        log_seq;        ///< sequence number of the last formatted entry
+private nosave string   stamp_ctime,    ///< ctime(stamp_time)
+                        stamp_iso;      ///< stamp_time as ISO-8601
+
+/// @brief storms
+///
+/// recently logged messages by fingerprint (program of the logger, facility
+/// and format string):
+/// ([
+///    "fingerprint" : ({ window start, # repeats suppressed, uid, gid, priority, format }),
+///     ...
+/// ])
+private nosave mapping  storms;
+/// @brief buckets
+///
+/// token bucket per uid:
+/// ([ "uid" : ({ tokens, last refill, # messages suppressed }), ... ])
+private nosave mapping  buckets;
+/// @brief recent
+///
+/// flight recorder: ring of the last RECENT_SIZE formatted entries over all
+/// destinations, allocated once, recent_total % RECENT_SIZE is the next slot
+private nosave string  *recent;
+private nosave int      recent_total,   ///< # entries ever recorded
+                        recent_dumped;  ///< recent_total at the last dump
+private nosave int      storm_handle,   ///< call_out handle of the next storm sweep
+                        deduplicated,   ///< # messages collapsed into a repeat summary
+                        rate_limited;   ///< # messages suppressed by the token buckets
+private nosave int      compress_handle,///< call_out handle of the next compression slice
+                        rotations,      ///< # rotated files
+                        compressions;   ///< # compressed files
+
+private void    enqueue(string uid, string gid, int priority, string body, int t);
+private string  format_msg(string file, string uid, string gid, int priority, string body, int t);
+private void    format_stamp(int t);
+private void    write_index(string file, string *msgs);
+private void    flush_all(int sync);
+private void    flush_file(string file, int sync);
+private void    flush_timer(void);
 private void    initialize();
+private void    push_levels(void);
+private void    rotate(string file);
+private string *recent_entries(int n);
+private void    write_recent(string reason);
+private int     storm_filter(object logger, string uid, string gid, int priority, string format, string body);
+private void    storm_summary(string fp, mixed *entry);
+private void    storm_sweep(void);
+private void    rotate_check(string file);
+#ifdef __PACKAGE_COMPRESS__
+private void    compress(string file);
+private void    compress_slice(void);
+#endif
+#ifdef __PACKAGE_ASYNC__
+private void    write_done(string file, int res);
+#endif
 
 void create()
 {
     init_done = FALSE;
-    call_out( (: initialize :), 1);
+    buffers   = ([]);
+    buf_sizes = ([]);
+    in_flight = ([]);
+    file_sizes     = ([]);
+    compress_queue = ({});
+    index_next     = ([]);
+    level_names    = ({ "unknown", "emergency", "alert", "critical", "error",
+            "warning", "notice", "info", "debug", "user1", "user2", "user3",
+            "user4", "user5", "user6", "user7" });
+#ifdef __PACKAGE_ASYNC__
+    async_mode = TRUE;
+#endif
+    pre_init  = ({});
+    storms    = ([]);
+    buckets   = ([]);
+    recent    = allocate(RECENT_SIZE);
+    // synchronously, so logging works before the first preload
+    initialize();
 }
 
 int clean_up(int arg)
@@ -31,6 +190,21 @@ int clean_up(int arg)
     return 0;
 }
 
+// event handler
+public void event_shutdown(void)
+{
+    if(origin() != ORIGIN_EFUN)
+        return;
+    // unless already dumped by master::crash or sefun::shutdown
+    if(recent_total != recent_dumped)
+        write_recent("shutdown");
+    // no completion will come for writes still in flight
+    foreach(string file, int n in in_flight)
+        unconfirmed += n;
+    in_flight = ([]);
+    flush_all(TRUE);
+}
+
 // --------------------------------------------------------------------------
 /// @brief initialize
 ///
@@ -51,70 +225,999 @@ private void initialize()
                     LOG_KERN  : LOG_DIR "kernel",
                     LOG_AUTH  : LOG_DIR "auth",
                     LOG_DAEMON: LOG_DIR "daemon",
-                    ]);
+                    ]),
                 ]);
     }
 
+    if(!level_facility)
+        level_facility = ([]);
+    if(!level_uid)
+        level_uid = ([]);
+    if(!rotate_size)
+        rotate_size = ([]);
+    if(!rotate_keep)
+        rotate_keep = ([]);
+    if(!structured)
+        structured = ([]);
+    push_levels();
+
     co_handles = ({ });
     init_done = TRUE;
+
+    // drain whatever was logged meanwhile, in order
+    foreach(mixed *entry in pre_init)
+        enqueue(entry[0], entry[1], entry[2], entry[3], entry[4]);
+    pre_init = ({});
+}
+
+// --------------------------------------------------------------------------
+/// @brief push_levels
+///
+/// the levels are checked by sefun::syslog before formatting a message, so
+/// they are held by the simul_efun object
+/// @Returns -
+// --------------------------------------------------------------------------
+private void push_levels(void)
+{
+    set_log_levels(copy(level_facility), copy(level_uid));
 }
 
 // --------------------------------------------------------------------------
 /// @brief get_file_name - get name of log file to be used
 ///
 /// This function parses the 'log_file_dict' and yields, depending on the
-/// object wanting to log something and the facility to be used, the file name
+/// user wanting to log something and the facility to be used, the file name
 /// to be used for the log file.
-/// @Param logger
+/// @Param uid - uid of the logging object
 /// @Param facility
 /// @Returns - log file name
 // --------------------------------------------------------------------------
-private string get_file_name(object logger, int facility)
+private string get_file_name(string uid, int facility)
 {
     mapping entry;
+    string  file;
+
+    if((entry = log_file_dict[uid]) && (file = entry[facility]))
+        return file;
+    if(file = log_file_dict[BB_UID][facility])
+        return file;
+    return log_file_dict[BB_UID][LOG_SYSLOG];
+}
+
+// --------------------------------------------------------------------------
+/// @brief flush_file
+///
+/// writes everything buffered for file at once. In async mode the write is
+/// done via async_write, unless
+/// - a write for file is still in flight: the messages stay buffered and are
+///   written on its completion (keeps the order within the file), even if
+///   sync is requested
+/// - ASYNC_MAX writes are in flight: write synchronously (back-pressure)
+///
+/// On shutdown no completion will come, so event_shutdown forgets the writes
+/// in flight and the messages are written behind them right away. The
+/// messages of those writes are counted as unconfirmed: they are lost if the
+/// driver exits before the write finished, otherwise they might end up
+/// behind the ones written at shutdown.
+/// @Param file
+/// @Param sync - TRUE: write synchronously in any case
+/// @Returns -
+// --------------------------------------------------------------------------
+private void flush_file(string file, int sync)
+{
+    string *msgs = buffers[file];
+
+    if(!msgs)
+        return;
+    if(in_flight[file])
+        return;
+    map_delete(buffers, file);
+    buffered -= buf_sizes[file];
+    if(undefinedp(file_sizes[file]) && ((file_sizes[file] = file_size(file)) < 0))
+        file_sizes[file] = 0;
+    if(structured[file])
+        write_index(file, msgs);
+    file_sizes[file] += buf_sizes[file];
+    map_delete(buf_sizes, file);
+
+#ifdef __PACKAGE_ASYNC__
+    if(async_mode && !sync)
+    {
+        if(sizeof(in_flight) < ASYNC_MAX)
+        {
+            in_flight[file] = sizeof(msgs);
+            async_writes++;
+            async_write(file, implode(msgs, ""), 0, (: write_done, file :));
+            return;
+        }
+        sync_fallbacks++;
+    }
+#endif
+    writes++;
+    if(!write_file(file, implode(msgs, ""), 0))
+        dropped += sizeof(msgs);
+    if(!in_flight[file])
+        rotate_check(file);
+}
+#ifdef __PACKAGE_ASYNC__
+// --------------------------------------------------------------------------
+/// @brief write_done
+///
+/// completion callback of async_write, starts the next write for file if
+/// messages were buffered meanwhile
+/// @Param file
+/// @Param res - result of the write, < 0 on error
+/// @Returns -
+// --------------------------------------------------------------------------
+private void write_done(string file, int res)
+{
+    if(res < 0)
+    {
+        async_errors++;
+        dropped += in_flight[file];
+    }
+    map_delete(in_flight, file);
+    rotate_check(file);
+    if(buffers[file])
+        flush_file(file, FALSE);
+}
+#endif
+// --------------------------------------------------------------------------
+/// @brief rotate_check
+///
+/// rotates file once it reached its size limit, never called while a write
+/// to file is in flight
+/// @Param file
+/// @Returns -
+// --------------------------------------------------------------------------
+private void rotate_check(string file)
+{
+    if(file_sizes[file] >= (rotate_size[file] || ROTATE_SIZE))
+        rotate(file);
+}
+// --------------------------------------------------------------------------
+/// @brief rotate
+///
+/// file.N is dropped, file.1 ... file.N-1 are shifted by one and file becomes
+/// file.1, which is compressed later on (one file per call_out slice).
+///
+/// A rotated file may be plain (structured when rotated, still waiting for
+/// compression or its compression failed) or compressed, whatever the file
+/// is now. So both variants (and the time index) are shifted, files waiting
+/// for compression keep their queue entry, and rotating never compresses
+/// within the logging path.
+/// @Param file
+/// @Returns -
+// --------------------------------------------------------------------------
+private void rotate(string file)
+{
+    string  first    = file + ".1",
+           *suffixes = ({ "", INDEX_SUFFIX });
+    int     keep     = rotate_keep[file] || ROTATE_KEEP,
+            i;
+#ifdef __PACKAGE_COMPRESS__
+    int     j;
+
+    suffixes += ({ ROTATE_SUFFIX });
+#endif
+
+    foreach(string suffix in suffixes)
+        if(file_size(file + "." + keep + suffix) >= 0)
+            rm(file + "." + keep + suffix);
+#ifdef __PACKAGE_COMPRESS__
+    compress_queue -= ({ file + "." + keep });
+#endif
+    for(i = keep - 1; i > 0; i--)
+    {
+        foreach(string suffix in suffixes)
+            if(file_size(file + "." + i + suffix) >= 0)
+                rename(file + "." + i + suffix, file + "." + (i + 1) + suffix);
+#ifdef __PACKAGE_COMPRESS__
+        if((j = member_array(file + "." + i, compress_queue)) != -1)
+            compress_queue[j] = file + "." + (i + 1);
+#endif
+    }
+    rename(file, first);
+    if(file_size(file + INDEX_SUFFIX) >= 0)
+        rename(file + INDEX_SUFFIX, first + INDEX_SUFFIX);
+    file_sizes[file] = 0;
+    map_delete(index_next, file);
+    rotations++;
+
+#ifdef __PACKAGE_COMPRESS__
+    if(!structured[file])
+    {
+        compress_queue += ({ first });
+        if(!compress_handle)
+            compress_handle = call_out( (: compress_slice :), COMPRESS_DELAY);
+    }
+#endif
+}
+#ifdef __PACKAGE_COMPRESS__
+// --------------------------------------------------------------------------
+/// @brief compress
+///
+/// if compressing fails file stays plain, rotate shifts it just the same
+/// @Param file - rotated log file, replaced by file.gz
+/// @Returns -
+// --------------------------------------------------------------------------
+private void compress(string file)
+{
+    if(!compress_file(file))
+    {
+        syslog(LOG_SYSLOG|LOG_ERR, "syslogd: compressing %s failed", file);
+        return;
+    }
+    if(file_size(file) >= 0)
+        rm(file);
+    compressions++;
+}
+// --------------------------------------------------------------------------
+/// @brief compress_slice
+///
+/// compresses one rotated file per call, so a burst of rotations doesn't
+/// end up in a single (too long) evaluation. Slicing is per file only, each
+/// file is compressed by a single compress_file() call.
+/// @Returns -
+// --------------------------------------------------------------------------
+private void compress_slice(void)
+{
+    string file;
+
+    compress_handle = 0;
+    if(!sizeof(compress_queue))
+        return;
+    file           = compress_queue[0];
+    compress_queue = compress_queue[1..];
+    compress(file);
+    if(sizeof(compress_queue))
+        compress_handle = call_out( (: compress_slice :), COMPRESS_DELAY);
+}
+#endif
+// --------------------------------------------------------------------------
+/// @brief flush_all
+/// @Param sync - TRUE: don't use async writes (shutdown)
+/// @Returns -
+// --------------------------------------------------------------------------
+private void flush_all(int sync)
+{
+    if(flush_handle)
+    {
+        remove_call_out(flush_handle);
+        flush_handle = 0;
+    }
+    foreach(string file in keys(buffers))
+        flush_file(file, sync);
+}
+// --------------------------------------------------------------------------
+/// @brief flush_timer
+///
+/// end of a flush window, everything buffered meanwhile is written
+/// @Returns -
+// --------------------------------------------------------------------------
+private void flush_timer(void)
+{
+    flush_handle = 0;
+    flush_all(FALSE);
+}
+// --------------------------------------------------------------------------
+/// @brief write_index
+///
+/// appends time index entries for those records of a batch crossing the next
+/// INDEX_STEP boundary, to be called before file_sizes is advanced
+/// @Param file - structured log file
+/// @Param msgs - records about to be written
+/// @Returns -
+// --------------------------------------------------------------------------
+private void write_index(string file, string *msgs)
+{
+    string  idx = "";
+    int     pos = file_sizes[file];
+
+    if(undefinedp(index_next[file]))
+    {
+        // resume an existing index
+        int isize = file_size(file + INDEX_SUFFIX);
+
+        if(isize >= INDEX_REC)
+            index_next[file] = to_int(read_bytes(file + INDEX_SUFFIX,
+                        isize - INDEX_REC + 11, 12)) + INDEX_STEP;
+        else
+            index_next[file] = 0;
+    }
+    foreach(string msg in msgs)
+    {
+        if(pos >= index_next[file])
+        {
+            idx += sprintf("%010d %012d\n", to_int(msg[0..9]), pos);
+            index_next[file] = pos + INDEX_STEP;
+        }
+        pos += byte_length(msg);
+    }
+    if(sizeof(idx))
+        write_file(file + INDEX_SUFFIX, idx, 0);
+}
+// --------------------------------------------------------------------------
+/// @brief format_msg
+/// @Param file - destination
+/// @Param uid
+/// @Param gid
+/// @Param priority - facility | level
+/// @Param body - the message itself
+/// @Param t - time the message was logged at
+/// @Returns complete log line for file (see structured)
+// --------------------------------------------------------------------------
+private string format_msg(string file, string uid, string gid, int priority, string body, int t)
+{
+    int level = (priority & LOG_LEVEL) >> LOG_SHIFT,
+        seq   = ++log_seq % 1000000;
+
+    if(t != stamp_time)
+        format_stamp(t);
+    if(structured[file])
+        return sprintf("%010d %06d %s %03d %02d %-16.16s %-16.16s %s\n", t, seq,
+                stamp_iso, priority & LOG_FACILITY, level, uid || "-", gid || "-",
+                replace_string(body, "\n", "\\n"));
+    return sprintf("%s #%06d [%s]: '%s'\n", stamp_ctime, seq, level_names[level], body);
+}
+// --------------------------------------------------------------------------
+/// @brief format_stamp
+///
+/// sets stamp_time and the time stamps derived from it
+/// @Param t - time
+/// @Returns -
+// --------------------------------------------------------------------------
+private void format_stamp(int t)
+{
+    mixed  *lt   = localtime(t);
+    int     off  = lt[LT_GMTOFF] / 60,
+            sign = '+';
+
+    if(off < 0)
+    {
+        off  = -off;
+        sign = '-';
+    }
+    stamp_time  = t;
+    stamp_ctime = ctime(t);
+    stamp_iso   = sprintf("%04d-%02d-%02dT%02d:%02d:%02d%c%02d%02d",
+            lt[LT_YEAR], lt[LT_MON] + 1, lt[LT_MDAY],
+            lt[LT_HOUR], lt[LT_MIN], lt[LT_SEC],
+            sign, off / 60, off % 60);
+}
+// --------------------------------------------------------------------------
+/// @brief enqueue
+///
+/// buffers a message for its destination, the first message of a flush
+/// window schedules the flush
+/// @Param uid - uid of the logging object
+/// @Param gid - gid of the logging object
+/// @Param priority - facility | level
+/// @Param body - the message itself
+/// @Param t - time the message was logged at
+/// @Returns -
+// --------------------------------------------------------------------------
+private void enqueue(string uid, string gid, int priority, string body, int t)
+{
+    string  file,
+            msg;
+    int     len;
 
-    if(entry = log_file_dict[get_uid(logger)])
-        return entry[facility];
+    if(!init_done)                      // queued until initialize is done
+    {
+        if(sizeof(pre_init) < PRE_INIT_MAX)
+            pre_init += ({ ({ uid, gid, priority, body, t }) });
+        else
+            dropped++;
+        return;
+    }
+
+    file = get_file_name(uid, priority & LOG_FACILITY);
+    msg  = format_msg(file, uid, gid, priority, body, t);
+    len  = byte_length(msg);
+
+    recent[recent_total++ % RECENT_SIZE] = msg;
+
+    if(buffered + len > BUFFER_MAX)
+    {
+        flush_all(FALSE);
+        if(buffered + len > BUFFER_MAX)     // still no room (writes in flight)
+        {
+            dropped++;
+            return;
+        }
+    }
+
+    messages++;
+    if(buffers[file])
+        buffers[file] += ({ msg });
     else
-        return log_file_dict[BB_UID][facility];
+        buffers[file] = ({ msg });
+    buf_sizes[file] += len;
+    buffered        += len;
+
+    if(buf_sizes[file] >= FLUSH_SIZE)
+        flush_file(file, FALSE);
+    else if(!flush_handle)
+        flush_handle = call_out( (: flush_timer :), FLUSH_DELAY);
 }
 
+// --------------------------------------------------------------------------
+/// @brief storm_summary
+///
+/// logs how often the message of a fingerprint was suppressed
+/// @Param fp - fingerprint
+/// @Param entry - storms[fp]
+/// @Returns -
+// --------------------------------------------------------------------------
+private void storm_summary(string fp, mixed *entry)
+{
+    if(entry[1])
+        enqueue(entry[2], entry[3], entry[4],
+                sprintf("last message repeated %d times within %d seconds (%s)",
+                    entry[1], time() - entry[0], entry[5]), time());
+}
+// --------------------------------------------------------------------------
+/// @brief storm_sweep
+///
+/// summarizes and forgets expired fingerprints, forgets idle token buckets
+/// @Returns -
+// --------------------------------------------------------------------------
+private void storm_sweep(void)
+{
+    int now = time();
+
+    storm_handle = 0;
+    foreach(string fp, mixed *entry in storms)
+    {
+        if(now - entry[0] >= STORM_WINDOW)
+        {
+            storm_summary(fp, entry);
+            map_delete(storms, fp);
+        }
+    }
+    foreach(string uid, int *bucket in buckets)
+    {
+        if((now - bucket[1]) * BUCKET_RATE >= BUCKET_BURST)
+        {
+            if(bucket[2])
+                enqueue(uid, 0, LOG_SYSLOG|LOG_WARNING,
+                        sprintf("%d messages of %s suppressed by rate limit", bucket[2], uid),
+                        now);
+            map_delete(buckets, uid);
+        }
+    }
+    if(sizeof(storms) || sizeof(buckets))
+        storm_handle = call_out( (: storm_sweep :), STORM_WINDOW);
+}
+// --------------------------------------------------------------------------
+/// @brief storm_filter
+///
+/// collapses repeats of a message within STORM_WINDOW into a single summary
+/// and rate limits each uid by a token bucket, levels up to LOG_CRIT pass
+/// always
+///
+/// messages are told apart by logger, facility and format. A bare "%s"
+/// format (e.g. runtime errors logged by master) says nothing about the
+/// message, the (first STORM_BODY characters of the) body is used instead.
+/// @Param logger - object calling sefun::syslog
+/// @Param uid
+/// @Param gid
+/// @Param priority - facility | level
+/// @Param format - format string given to sefun::syslog
+/// @Param body - formatted message
+/// @Returns TRUE if the message is to be logged
+// --------------------------------------------------------------------------
+private int storm_filter(object logger, string uid, string gid, int priority, string format, string body)
+{
+    mixed  *entry;
+    int    *bucket;
+    string  fp;
+    int     now = time();
+
+    if((priority & LOG_LEVEL) <= LOG_CRIT)
+        return TRUE;
+
+    if(!format || (format == "%s"))
+        format = (body || "")[0..(STORM_BODY - 1)];
+    fp = sprintf("%s\t%d\t%s", logger ? base_name(logger) : "-",
+            priority & LOG_FACILITY, format);
+    if(entry = storms[fp])
+    {
+        if(now - entry[0] < STORM_WINDOW)
+        {
+            entry[1]++;
+            deduplicated++;
+            return FALSE;
+        }
+        storm_summary(fp, entry);
+        map_delete(storms, fp);
+    }
+
+    // token bucket
+    if(!(bucket = buckets[uid]))
+        bucket = buckets[uid] = ({ BUCKET_BURST, now, 0 });
+    else if(now > bucket[1])
+    {
+        bucket[0] += (now - bucket[1]) * BUCKET_RATE;
+        if(bucket[0] > BUCKET_BURST)
+            bucket[0] = BUCKET_BURST;
+        bucket[1]  = now;
+    }
+    if(bucket[0] < 1)
+    {
+        bucket[2]++;
+        rate_limited++;
+        return FALSE;
+    }
+    bucket[0]--;
+    if(bucket[2])
+    {
+        enqueue(uid, gid, LOG_SYSLOG|LOG_WARNING,
+                sprintf("%d messages of %s suppressed by rate limit", bucket[2], uid), now);
+        bucket[2] = 0;
+    }
+
+    if(sizeof(storms) >= STORM_MAX)     // full, just log it untracked
+        return TRUE;
+    storms[fp] = ({ now, 0, uid, gid, priority, format[0..63] });
+    if(!storm_handle)
+        storm_handle = call_out( (: storm_sweep :), STORM_WINDOW);
+    return TRUE;
+}
+// --------------------------------------------------------------------------
+/// @brief recent_entries
+/// @Param n - # of entries wanted
+/// @Returns up to n of the most recent entries, oldest first
+// --------------------------------------------------------------------------
+private string *recent_entries(int n)
+{
+    string *ret;
+    int     i;
+
+    if((n <= 0) || (n > RECENT_SIZE))
+        n = RECENT_SIZE;
+    if(n > recent_total)
+        n = recent_total;
+    ret = allocate(n);
+    for(i = 0; i < n; i++)
+        ret[i] = recent[(recent_total - n + i) % RECENT_SIZE];
+    return ret;
+}
+// --------------------------------------------------------------------------
+/// @brief write_recent
+///
+/// dumps the flight recorder to RECENT_DUMP (replacing the previous dump)
+/// @Param reason - why (written to the first line)
+/// @Returns -
+// --------------------------------------------------------------------------
+private void write_recent(string reason)
+{
+    recent_dumped = recent_total;
+    write_file(RECENT_DUMP,
+            sprintf("--- %s: last %d log entries (%s) ---\n", ctime(time()),
+                (recent_total < RECENT_SIZE) ? recent_total : RECENT_SIZE, reason) +
+            implode(recent_entries(0), ""), 1);
+}
 // --------------------------------------------------------------------------
 /// @brief log - writing log entries
+///
+/// messages are formatted according to their destination and buffered per
+/// log file, to be written in batches (see enqueue)
 /// @Param logger - object calling sefun::syslog
-/// @Param facility - facility given in call to sefun::syslog
-/// @Param msg - message to be written
-/// @Param retry - retry counter if syslogd not yet initialized
+/// @Param uid - uid given to sefun::syslog
+/// @Param gid - gid given to sefun::syslog
+/// @Param priority - facility | level given in call to sefun::syslog
+/// @Param body - message to be written (without time stamp etc.)
+/// @Param format - format string body was made of (for storm suppression)
 /// @Returns -
 // --------------------------------------------------------------------------
-public varargs void log(object logger, int facility, string msg, int retry = 5)
+public void log(object logger, string uid, string gid, int priority, string body, string format)
+{
+    if(PO() != simul_efun())
+    {
+        syslog(LOG_SYSLOG|LOG_NOTICE, "unprivileged call to syslogd: %O", PO());
+        return;
+    }
+    if(storm_filter(logger, uid, gid, priority, format, body))
+        enqueue(uid, gid, priority, body, time());
+}
+// --------------------------------------------------------------------------
+/// @brief flush
+///
+/// writes all buffered messages immediately, except for files with an async
+/// write still in flight: those are written as soon as it completed
+/// @Returns -
+// --------------------------------------------------------------------------
+public void flush(void)
+{
+    if((PO() != master()) && (geteuid(PO()) != ROOT_UID))
+        return;
+    flush_all(TRUE);
+}
+// --------------------------------------------------------------------------
+/// @brief set_async
+///
+/// switches between async and synchronous writes, without PACKAGE_ASYNC
+/// writes are always synchronous
+/// @Param flag - TRUE: use async_write
+/// @Returns the mode now in effect
+// --------------------------------------------------------------------------
+public int set_async(int flag)
+{
+    if(geteuid(PO()) != ROOT_UID)
+        return async_mode;
+#ifdef __PACKAGE_ASYNC__
+    async_mode = !!flag;
+#endif
+    return async_mode;
+}
+// --------------------------------------------------------------------------
+/// @brief set_log_level
+///
+/// sets the least urgent level still logged for a facility or uid, takes
+/// effect immediately
+/// @Param what - facility (int) or uid (string)
+/// @Param level - LOG_WARNING ... LOG_USER7, 0 to log everything again
+/// @Returns TRUE on success
+// --------------------------------------------------------------------------
+public int set_log_level(mixed what, int level)
 {
-    int log_ok = FALSE;     // is logging allowed?
+    mapping levels;
+
+    if(geteuid(PO()) != ROOT_UID)
+        return FALSE;
+    if(intp(what))
+        levels = level_facility;
+    else if(stringp(what))
+        levels = level_uid;
+    else
+        return FALSE;
 
-    switch(origin())
+    if(!level)
+        map_delete(levels, what);
+    else if((level & LOG_FACILITY) || (level < LOG_WARNING) || (level > LOG_LEVEL))
+        return FALSE;
+    else
+        levels[what] = level;
+
+    save_object(SAVE_FILE);
+    push_levels();
+    return TRUE;
+}
+// --------------------------------------------------------------------------
+/// @brief set_rotation
+///
+/// configures rotation of a single log file
+/// @Param file - log file (as given in log_file_dict)
+/// @Param size - rotate once file reaches size bytes, 0 for ROTATE_SIZE
+/// @Param keep - # of rotated files kept, 0 for ROTATE_KEEP
+/// @Returns TRUE on success
+// --------------------------------------------------------------------------
+public int set_rotation(string file, int size, int keep)
+{
+    if(geteuid(PO()) != ROOT_UID)
+        return FALSE;
+    if(!stringp(file) || (size < 0) || (keep < 0))
+        return FALSE;
+
+    if(size)
+        rotate_size[file] = size;
+    else
+        map_delete(rotate_size, file);
+    if(keep)
+        rotate_keep[file] = keep;
+    else
+        map_delete(rotate_keep, file);
+    save_object(SAVE_FILE);
+    return TRUE;
+}
+// --------------------------------------------------------------------------
+/// @brief set_structured
+///
+/// switches a log file between plain text and structured records, takes
+/// effect with the next rotation of file (mixing formats isn't searchable)
+/// @Param file - log file (as given in log_file_dict)
+/// @Param flag - TRUE: structured records
+/// @Returns TRUE on success, FALSE also while a write to file is in flight
+// --------------------------------------------------------------------------
+public int set_structured(string file, int flag)
+{
+    if(geteuid(PO()) != ROOT_UID)
+        return FALSE;
+    if(!stringp(file) || in_flight[file])
+        return FALSE;
+
+    flush_all(TRUE);
+    if(file_size(file) > 0)
+        rotate(file);
+    if(flag)
+        structured[file] = 1;
+    else
+        map_delete(structured, file);
+    save_object(SAVE_FILE);
+    return TRUE;
+}
+// --------------------------------------------------------------------------
+/// @brief index_start
+///
+/// binary search in the time index of file
+/// @Param file - structured log file
+/// @Param from - time
+/// @Returns offset of the last indexed record older than from, 0 if none
+// --------------------------------------------------------------------------
+private int index_start(string file, int from)
+{
+    string  idx = file + INDEX_SUFFIX;
+    int     lo  = 0,
+            hi  = file_size(idx) / INDEX_REC - 1,
+            ret = 0;
+
+    while(lo <= hi)
     {
-        case "call_out":
-            if(PO() = TO())
-                log_ok = TRUE;
-        case "simul":
+        int     mid   = (lo + hi) / 2;
+        string  entry = read_bytes(idx, mid * INDEX_REC, INDEX_REC);
+
+        if(!entry)
             break;
-        default:
-            syslog(LOG_SYSLOG|iLOG_NOTICE, "unprivileged call to syslogd: %O", logger);
-            brewk;
+        if(to_int(entry[0..9]) < from)
+        {
+            ret = to_int(entry[11..22]);
+            lo  = mid + 1;
+        }
+        else
+            hi = mid - 1;
+    }
+    return ret;
+}
+// --------------------------------------------------------------------------
+/// @brief query_file
+///
+/// streams the records of a single structured file in read_bytes windows
+/// starting at the offset found in its index or at a resume offset
+/// @Param file
+/// @Param from - time
+/// @Param to - time
+/// @Param filter - see query_log
+/// @Param limit - max. # of records
+/// @Param start - byte offset of a record to resume at, -1 to use the index
+/// @Param budget - max. # of bytes to read
+/// @Returns ({ done, ({ record, ... }), next, read }), done is TRUE if a
+///          record newer than to was found or limit was reached (no need to
+///          look further), next is the offset to resume at if budget ran out
+///          before the end of the file, else -1, read the # of bytes read
+// --------------------------------------------------------------------------
+private mixed *query_file(string file, int from, int to, mapping filter, int limit,
+        int start, int budget)
+{
+    mixed  *ret  = ({});
+    string  rest = "";
+    int     size = file_size(file),
+            pos  = (start >= 0) ? start : index_start(file, from),
+            begin,
+            end,
+            skip;
+
+    // start one byte early and drop the first (partial) line, so an index
+    // entry pointing at the start of a record still works
+    if((start < 0) && (pos > 0))
+    {
+        pos--;
+        skip = TRUE;
     }
-    if(log_ok)
+    begin = pos;
+    end   = pos + budget;
+    while(pos < size)
     {
-        if(init_done)
+        string  chunk,
+               *lines;
+
+        if(pos >= end)                  // out of budget, resume at rest
+            return ({ FALSE, ret, pos - byte_length(rest), pos - begin });
+        if(!(chunk = read_bytes(file, pos, QUERY_WINDOW)))
+            break;
+        pos  += QUERY_WINDOW;
+        lines = explode(rest + chunk, "\n");
+        if(chunk[<1] != '\n')
         {
-            if(!write_file(get_file_name(logger, facility), msg, 0))
-                error("syslogd::log: error writing log file");
+            rest  = lines[<1];
+            lines = lines[0..<2];
         }
-        else if(retry)
+        else
+            rest = "";
+        if(skip && sizeof(lines))
         {
-            call_out( (: log :), 1, logger, facility, msg, retry - 1);
+            lines = lines[1..];
+            skip  = FALSE;
         }
+
+        foreach(string line in lines)
+        {
+            mixed *rec;
+            int    t;
+
+            if(strlen(line) < 84)
+                continue;
+            if((t = to_int(line[0..9])) < from)
+                continue;
+            if(t > to)
+                return ({ TRUE, ret, -1, pos - begin });
+            rec = ({ t, to_int(line[43..45]), to_int(line[47..48]) << LOG_SHIFT,
+                    replace_string(line[50..65], " ", ""),
+                    replace_string(line[67..82], " ", ""),
+                    replace_string(line[84..], "\\n", "\n") });
+            if(filter)
+            {
+                if(filter["facility"] && (filter["facility"] != rec[1]))
+                    continue;
+                if(filter["level"] && (rec[2] > filter["level"]))
+                    continue;
+                if(filter["uid"] && (filter["uid"] != rec[3]))
+                    continue;
+                if(filter["gid"] && (filter["gid"] != rec[4]))
+                    continue;
+            }
+            ret += ({ rec });
+            if(sizeof(ret) >= limit)
+                return ({ TRUE, ret, -1, pos - begin });
+        }
+    }
+    return ({ FALSE, ret, -1, pos - begin });
+}
+// --------------------------------------------------------------------------
+/// @brief query_log
+///
+/// searches a structured log file (including its rotated predecessors) for
+/// records within a time range, only the byte ranges found via the time
+/// indices are read
+///
+/// a single call reads at most QUERY_BUDGET bytes, so a filter rejecting
+/// most records can't run into the eval cost limit. If the budget runs out
+/// a cursor is returned, pass it back with the same arguments to continue
+/// where the previous call stopped:
+///
+///     res = SYSLOG_D->query_log(file, from, to, filter);
+///     while(res[1])
+///         res = SYSLOG_D->query_log(file, from, to, filter, limit, res[1]);
+///
+/// (usually from a call_out, one slice per call)
+/// @Param file - structured log file
+/// @Param from - time
+/// @Param to - time
+/// @Param filter - ([ "facility": #, "level": least urgent LOG_*, "uid": "uid", "gid": "gid" ]),
+///                 all optional
+/// @Param limit - max. # of records returned, default QUERY_LIMIT
+/// @Param cursor - returned by the previous call, 0 to start a new query
+/// @Returns ({ ({ ({ time, facility, level, uid, gid, message }), ... }), cursor }),
+///          records oldest first, cursor is 0 once the query is complete
+// --------------------------------------------------------------------------
+public mixed *query_log(string file, int from, int to, mapping filter = 0,
+        int limit = QUERY_LIMIT, mixed *cursor = 0)
+{
+    mixed  *ret    = ({});
+    int     keep   = rotate_keep[file] || ROTATE_KEEP,
+            budget = QUERY_BUDGET,
+            start  = -1,
+            i      = keep;
+
+    if(geteuid(PO()) != ROOT_UID)
+        return 0;
+    if(!stringp(file) || !structured[file])
+        return 0;
+
+    flush_all(TRUE);
+    if(cursor)
+    {
+        if((sizeof(cursor) != 3) || !intp(cursor[0]) || !intp(cursor[1]))
+            return 0;
+        // files rotated since the last call moved up, follow the one the
+        // cursor points into by the stamp of its first record
+        for(i = cursor[0]; i <= keep; i++)
+            if(read_bytes(i ? (file + "." + i) : file, 0, 10) == cursor[2])
+                break;
+        if(i <= keep)
+            start = cursor[1];
         else
-            error("syslogd::log: error initializing syslogd");
+            i = keep;                   // rotated out, go on with the oldest
     }
+
+    for(; i >= 0; i--)
+    {
+        string  f = i ? (file + "." + i) : file;
+        mixed  *res;
+
+        if(file_size(f) <= 0)
+        {
+            start = -1;
+            continue;
+        }
+        res  = query_file(f, from, to, filter, limit - sizeof(ret), start, budget);
+        ret += res[1];
+        if(res[0])
+            break;
+        if(res[2] >= 0)
+            return ({ ret, ({ i, res[2], read_bytes(f, 0, 10) }) });
+        budget -= res[3];
+        start   = -1;
+    }
+    return ({ ret, 0 });
+}
+// --------------------------------------------------------------------------
+/// @brief query_log_levels
+/// @Returns ({ ([ facility : level, ... ]), ([ "uid" : level, ... ]) })
+// --------------------------------------------------------------------------
+public mixed *query_log_levels(void)
+{
+    return ({ copy(level_facility), copy(level_uid) });
+}
+// --------------------------------------------------------------------------
+/// @brief query_recent
+///
+/// flight recorder, answered from memory without touching the log files
+/// @Param n - # of entries wanted, 0 for all
+/// @Returns the last n log entries over all destinations, oldest first
+// --------------------------------------------------------------------------
+public string *query_recent(int n)
+{
+    if(geteuid(PO()) != ROOT_UID)
+        return 0;
+    return recent_entries(n);
+}
+// --------------------------------------------------------------------------
+/// @brief dump_recent
+///
+/// writes the flight recorder to RECENT_DUMP, called by master::crash and
+/// sefun::shutdown
+/// @Param reason - written to the first line of the dump
+/// @Returns -
+// --------------------------------------------------------------------------
+public void dump_recent(string reason)
+{
+    if((PO() != master()) && (geteuid(PO()) != ROOT_UID))
+        return;
+    write_recent(reason || "requested");
+}
+// --------------------------------------------------------------------------
+/// @brief query_storm_stats
+/// @Returns ([ "deduplicated": #, "rate_limited": #, "fingerprints": #, "buckets": # ])
+// --------------------------------------------------------------------------
+public mapping query_storm_stats(void)
+{
+    if(geteuid(PO()) != ROOT_UID)
+        return 0;
+    return ([
+            "deduplicated": deduplicated,
+            "rate_limited": rate_limited,
+            "fingerprints": sizeof(storms),
+            "buckets":      sizeof(buckets),
+            ]);
+}
+// --------------------------------------------------------------------------
+/// @brief query_log_stats
+/// @Returns ([ "messages": #, "writes": #, "dropped": #, "buffered": bytes, "files": #,
+///            "async": mode, "async_writes": #, "async_errors": #, "in_flight": #,
+///            "unconfirmed": #, "sync_fallbacks": #, "rotations": #, "compressions": #,
+///            "compress_queue": # ])
+// --------------------------------------------------------------------------
+public mapping query_log_stats(void)
+{
+    if(geteuid(PO()) != ROOT_UID)
+        return 0;
+    return ([
+            "messages": messages,
+            "writes":   writes,
+            "dropped":  dropped,
+            "buffered": buffered,
+            "files":    sizeof(buffers),
+            "async":          async_mode,
+            "async_writes":   async_writes,
+            "async_errors":   async_errors,
+            "in_flight":      sizeof(in_flight),
+            "unconfirmed":    unconfirmed,
+            "sync_fallbacks": sync_fallbacks,
+            "rotations":      rotations,
+            "compressions":   compressions,
+            "compress_queue": sizeof(compress_queue),
+            ]);
 }
 ///  @}
@@ -13,7 +13,16 @@
 
 #define MASTER_SAVE     PRIV_SAVE_DIR "master"
 
+public mapping   benchmark_acl(int rounds);
 public int       check_acl(int request, string euid, string egid, mixed info);
+public string   *check_acl_many(int request, string euid, string egid, string func, string *paths);
+public void      invalidate_acl_cache(void);
+public mapping   query_acl_cache_stats(void);
+public mapping   query_apply_stats(void);
+public mixed    *query_top_errors(int n);
+public int       reload_config(string type);
+public void      set_member_groups(string uid, string *groups);
+public void      set_upriv_mask(string uid, int mask, mapping domains);
 public int       valid_read(string file, object ob, string func);
 public int       valid_write(string file, object ob, string func);
 
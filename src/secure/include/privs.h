@@ -22,6 +22,33 @@
 #define UPRIV_ARCH      "__Archwiz__"                   // arch wizard
 #define UPRIV_ADMIN     "__ADMIN__"                     // mud admin
 
+// user privileges interned as bit indices (master::check_acl)
+// these are indices into an int bitmask!
+#define UPRIV_B_ALL     0
+#define UPRIV_B_AUTHOR  1
+#define UPRIV_B_DOMAIN  2
+#define UPRIV_B_MORTAL  3
+#define UPRIV_B_ELDER   4
+#define UPRIV_B_WIZARD  5
+#define UPRIV_B_D_WIZ   6
+#define UPRIV_B_D_LORD  7
+#define UPRIV_B_ARCH    8
+#define UPRIV_B_ADMIN   9
+
+#define UPRIV_MASK(b)   (1 << (b))                      // bit index -> mask
+#define UPRIV_BIT_MAP   ([ \
+        UPRIV_ALL:      UPRIV_B_ALL,    \
+        UPRIV_AUTHOR:   UPRIV_B_AUTHOR, \
+        UPRIV_DOMAIN:   UPRIV_B_DOMAIN, \
+        UPRIV_MORTAL:   UPRIV_B_MORTAL, \
+        UPRIV_ELDER:    UPRIV_B_ELDER,  \
+        UPRIV_WIZARD:   UPRIV_B_WIZARD, \
+        UPRIV_D_WIZ:    UPRIV_B_D_WIZ,  \
+        UPRIV_D_LORD:   UPRIV_B_D_LORD, \
+        UPRIV_ARCH:     UPRIV_B_ARCH,   \
+        UPRIV_ADMIN:    UPRIV_B_ADMIN,  \
+        ])
+
 // standard uids
 #define BB_UID          "__backbone__"                  // backbone uid
 #define ROOT_UID        "__root__"                      // root uid
@@ -29,6 +29,10 @@ public          string   basename(string path);
 public          string   canonical_path(string path);
 public          string   dirname(string path);
 public          string   get_cwd(object who);
+public          int      mkdir(string dir);
+public          int      rmdir(string dir);
+public          mixed   *get_dir_listing(string dir);
+public          mapping  query_listing_cache_stats(void);
 // general
 public          int      cmp(mixed a, mixed b);
 public          int      get_debug(void);
@@ -36,6 +40,7 @@ public          int      set_debug(int val);
 // logging
 public varargs  void     syslog(int priority, string format, mixed *args...);
 public varargs  void     m_syslog(string uid, string gid, int priority, string format, mixed *args...)
+public          void     set_log_levels(mapping facilities, mapping uids);
 // math
 public          int      fib(int n);
 public          int      gcd(int a, int b);
@@ -43,16 +48,21 @@ public          int      lcm(int a, int b);
 // objects
 public          string   author_of(string file);
 public          string   domain_of(string file);
+public          void     flush_owner_cache(void);
+public          string   ownership_key(string file);
+public          mapping  query_owner_cache_stats(void);
 public varargs  void     destruct(object ob);
 public          string   file_name(object who = 0, int flag = 0);
 public          object   simul_efun(void);
 // regex_globbing
+public          mapping  benchmark_regex(string file, string pat, int rounds);
 public          int      fnmatch(string name, string pattern);
-public          string  *glob(mixed pathname);
+public          string  *glob(mixed pathname, int max_depth = 8, int max_results = 2048);
 public          string   gsub(string s, string pat, string repl);
 public          int      has_magic(string s);
 public          string   insensitive_pattern(string pat = "");
 public          string  *insensitive_regexp(string* arr, string pat, int flag = 0);
+public          mapping  query_pattern_cache_stats(void);
 public          string   reg_pat_translate(string pat, int flag = 0);
 public          string  *regexplode(string str, string pat);
 public          int      rsearch(string s, string pat);
@@ -80,7 +90,10 @@ public          int      archp(object ob);
 public          int      atoi(string arg);
 public          string   itoa(int arg);
 public          string   add_article(string text, int flag = 0);
+public          int      byte_length(string str);
 public          string   i_wrap(string text, int width = 80, int indent = 4);
+public          void     more(mixed arg, int height = DFLT_SCR_HEIGHT);
+public          void     more_file(string file, int height = DFLT_SCR_HEIGHT);
 public          string   remove_article(string text);
 // terminal
 public          string   blink(string str);
@@ -9,9 +9,14 @@
 #ifndef __SEC_SIMUL_EFUN_INTERN_H
 #define  __SEC_SIMUL_EFUN_INTERN_H
 
+private void init_file_system_sefuns(void);
+private void init_logging_sefuns(void);
 private void init_object_sefuns(void);
+private void init_strings_sefuns(void);
 private void init_terminal_sefuns(void);
 
+private mixed *cached_listing(string key);
+private void pager_input(object who, string ch);
 private varargs void _syslog(object caller, string uid, string gid, int priority, string format, mixed *args...);
 
 #endif;
@@ -18,8 +18,32 @@
 #include <privs.h>                  // privlege related defines
 #include <driver/parser_error.h>    // for master::parser_error_message
 
+// acl trie node keys, ints can't collide with path components
+#define ACL_NODE_SELF   0               ///< entry for "/some/path"
+#define ACL_NODE_DIR    1               ///< entry for "/some/path/"
+
+#define ACL_CACHE_SIZE  4096            ///< max. # of cached check_acl decisions
+#define CFG_RELOAD_LINES  64            ///< config lines parsed per reload_config slice
+#define ID_SPLIT_SIZE   1024            ///< max. # of cached "uid:gid" splits
+
+#define APPLY_STAT_SAMPLE 64            ///< every n-th call of an apply is timed via rusage
+#define APPLY_STAT_LOG  LOG_DIR "master_applies"    ///< written on every reset
+#define ERROR_SAMPLE    100             ///< every n-th repeat of an error is logged with trace again
+#define ERROR_MAX       512             ///< max. # of distinct errors aggregated
+
 // private function forward declarations
+private int      _valid_object(object ob);
+private int      _valid_override(string file, string efun_name, string mainfile);
+private int      _valid_read(string file, object ob, string func, int driver);
+private int      _valid_seteuid(object ob, string t_euid);
+private int      _valid_socket(object ob, string func, mixed *info);
+private int      _valid_write(string file, object ob, string func, int driver);
+private int      acl_decision(int request, string euid, string egid, mixed info, object ti);
 private int      retrieve_ed_setup(object user);
+private int      parse_privs_line(mapping ret, string line);
+private int      root_caller(string func);
+private int      member_of_group(string uid, string group);
+private int      upriv_mask(object ti, string domain);
 private int      save_ed_setup(object user, int config);
 private int      valid_bind(object doer, object owner, object victim);
 private int      valid_hide(object ob);
@@ -29,13 +53,25 @@ private int      valid_override(string file, string efun_name, string mainfile);
 private int      valid_seteuid(object ob, string t_euid);
 private int      valid_shadow(object ob);
 private int      valid_socket(object ob, string func, mixed *info);
+private int      acl_same(mapping raw, mapping compiled);
+private mapping  acl_lookup(mapping trie, string path);
+private mapping  compile_acl(mapping acl_list);
 private mapping  get_mud_stats(void);
 private mapping  init_acl(string type);
 private mapping  init_privileges(void);
+private mixed    apply_leave(mixed *st, mixed ret);
+private mixed   *acl(int request, mixed info);
+private mixed   *apply_enter(string apply);
+private mixed   *acl_principals(string *list);
+private string  *split_id(string id);
 private mixed    valid_database(object doer, string action, mixed *info);
 private object   compile_object(string pathname);
 private object   connect(int port);
 private object  *parse_command_users(void);
+private string   _creator_file(string filename);
+private string   acl_cache_dir(string path);
+private string   parse_acl_line(mapping ret, string path, string line);
+private string   acl_func_name(string func);
 private string   creator_file(string filename);
 private string   get_bb_uid(void);
 private string   get_root_uid(void);
@@ -46,7 +82,6 @@ private string   parse_command_all_word(void);
 private string   parse_command_all_word(void);
 private string   parser_error_message(int type, object ob, mixed arg, int flag);
 private string   privs_file(string file);
-private string  *acl(int request, mixed info);
 private string  *epilog(int dummy);
 private string  *get_include_path(string file);
 private string  *get_include_path(string file);
@@ -55,11 +90,16 @@ private string  *parse_command_id_list(void);
 private string  *parse_command_plural_id_list(void);
 private string  *parse_command_prepos_list(void);
 private string  *parse_command_prepos_list(void);
+private void     acl_trie_insert(mapping trie, string path, mapping entry);
+private void     acl_trie_remove(mapping trie, string path);
+private void     apply_reload(string type, string fn, mapping data);
+private void     write_apply_stats(void);
 private void     crash(string crash_message, object command_giver, object current_object);
 private void     error_handler(mapping err, int caught);
 private void     flag(string driver_flag);
 private void     log_error(string file, string message);
 private void     preload(string str);
+private void     reload_slice(string type);
 private void     save_master(void);
 private void     startup_summary(void);
 
@@ -79,6 +119,55 @@ private nosave int *startup_info;       ///< how many objects to be preloaded, e
 private mapping acl_read,               ///< acls for file read access
                 acl_write;              ///< acls for file write access
 
+/// @brief acl_trie_*
+///
+/// compiled form of acl_*, one node per path component:
+/// ([
+///    "component"   : <node>,
+///     ...
+///    ACL_NODE_SELF : ([ "function" : ({ UPRIV_* mask, ([ "uid" : 1, ..., "gid" : 1, ... ]) }), ... ]),
+///    ACL_NODE_DIR  : ([ "function" : ({ UPRIV_* mask, ([ "uid" : 1, ..., "gid" : 1, ... ]) }), ... ]),
+/// ])
+/// so a lookup only depends on the depth of the requested path, not on the
+/// number of acl entries
+private nosave mapping  acl_trie_read,  ///< compiled acl_read
+                        acl_trie_write, ///< compiled acl_write
+                        acl_exact;      ///< paths with an entry of their own (no trailing '/')
+
+/// @brief acl_cache
+///
+/// cached check_acl decisions, only valid as long as acl_cache_gen equals
+/// acl_generation which is bumped whenever acls or memberships change
+private nosave mapping  acl_cache;
+/// @brief upriv_masks
+///
+/// UPRIV_* granted to interactive users, maintained by MUD_INFO_D:
+/// ([
+///    "uid" : ({ mask, ([ "domain" : mask, ... ]) }),
+///     ...
+/// ])
+private nosave mapping  upriv_masks,
+                        upriv_bits;     ///< UPRIV_* -> bit index
+/// @brief member_groups
+///
+/// groups (UPRIV_*) of interactive users, maintained by MUD_INFO_D so
+/// valid_seteuid never has to ask for them:
+/// ([
+///    "uid" : ([ "group" : 1, ... ]),
+///     ...
+/// ])
+private nosave mapping  member_groups;
+/// @brief id_split
+///
+/// "uid:gid" strings as seen by valid_seteuid, already exploded:
+/// ([ "uid:gid" : ({ "uid", "gid" }), ... ])
+/// cleared whenever it exceeds ID_SPLIT_SIZE
+private nosave mapping  id_split;
+private nosave int      acl_generation,
+                        acl_cache_gen,
+                        acl_cache_hits,
+                        acl_cache_misses;
+
 /// @brief privileges
 ///
 /// data format:
@@ -89,6 +178,33 @@ private mapping acl_read,               ///< acls for file read access
 /// where assigned privileges is a bitfield (string)
 private mapping privileges;
 
+/// @brief apply_stats
+///
+/// instrumentation of the valid_* applies and creator_file:
+/// ([
+///    "apply" : ({ calls, eval cost, timed calls, utime, stime }),
+///     ...
+/// ])
+private nosave mapping apply_stats;
+
+/// @brief cfg_reloads
+///
+/// running reload_config requests:
+/// ([
+///    "type" : ([ "file": name, "mtime": #, "line": #, "path": current acl path, "data": parsed so far ]),
+///     ...
+/// ])
+private nosave mapping cfg_reloads;
+
+/// @brief error_stats
+///
+/// runtime errors aggregated by location and text:
+/// ([
+///    "file:line:error" : ({ count, first seen, last seen, # caught, file, line, error }),
+///     ...
+/// ])
+private nosave mapping error_stats;
+
 // std applies
 private void create()
 {
@@ -104,7 +220,8 @@ private void create()
 #endif
 
     // we use the efun directly, it's faster
-    efun::seteuid(creator_file(__MASTER_FILE__));
+    // (apply_stats isn't set up yet, so no instrumentation)
+    efun::seteuid(_creator_file(__MASTER_FILE__));
 
     startup_info[0] =           // # to be preloaded objects
     startup_info[1] =           // # how often preload called
@@ -118,6 +235,18 @@ private void create()
     if(!privileges)
         privileges = init_privileges();
 
+    upriv_bits     = UPRIV_BIT_MAP;
+    upriv_masks    = ([]);
+    member_groups  = ([]);
+    id_split       = ([]);
+    acl_exact      = ([]);
+    acl_trie_read  = compile_acl(acl_read);
+    acl_trie_write = compile_acl(acl_write);
+    acl_cache      = ([]);
+    cfg_reloads    = ([]);
+    error_stats    = ([]);
+    apply_stats    = ([]);
+
 #ifdef __HAS_RUSAGE__
     after = rusage();
     if(sizeof(before) && sizeof(after))
@@ -136,6 +265,7 @@ private int clean_up(int arg)
 private void reset()
 {
     save_object(MASTER_SAVE);
+    write_apply_stats();
 }
 
 // helper functions
@@ -166,6 +296,130 @@ private void save_master(void)
     else                                // now we can remove old backup
         rm(MASTER_SAVE + ".bak~");
 }
+// --------------------------------------------------------------------------
+/// @brief root_caller
+///
+/// guard for public functions meant for root only
+/// @Param func - name of the guarded function (for logging)
+/// @Returns TRUE if the calling object has effective root privileges
+// --------------------------------------------------------------------------
+private int root_caller(string func)
+{
+    object po = PO();
+
+    if((po == TO()) || (geteuid(po) == ROOT_UID))
+        return TRUE;
+
+    syslog(LOG_AUTH|LOG_ERR, "Privilege violation: master::%s by %O[%s]",
+            func, po, efun::geteuid(po));
+    return FALSE;
+}
+// --------------------------------------------------------------------------
+/// @brief apply_enter
+///
+/// to be called on entry of an instrumented apply, every APPLY_STAT_SAMPLE-th
+/// call is timed via rusage (just as preload does)
+/// @Param apply - name of the apply
+/// @Returns state to be handed to apply_leave
+// --------------------------------------------------------------------------
+private mixed *apply_enter(string apply)
+{
+    mixed *stat;
+
+    if(!(stat = apply_stats[apply]))
+        stat = apply_stats[apply] = ({ 0, 0, 0, 0, 0 });
+    stat[0]++;
+#ifdef __HAS_RUSAGE__
+    if(!(stat[0] % APPLY_STAT_SAMPLE))
+        return ({ stat, eval_cost(), rusage() });
+#endif
+    return ({ stat, eval_cost(), 0 });
+}
+// --------------------------------------------------------------------------
+/// @brief apply_leave
+/// @Param st - state returned by apply_enter
+/// @Param ret - result of the apply
+/// @Returns ret
+// --------------------------------------------------------------------------
+private mixed apply_leave(mixed *st, mixed ret)
+{
+    st[0][1] += st[1] - eval_cost();    // eval_cost() counts down
+#ifdef __HAS_RUSAGE__
+    if(st[2])
+    {
+        mapping after = rusage();
+
+        if(sizeof(st[2]) && sizeof(after))
+        {
+            st[0][2]++;
+            st[0][3] += after["utime"] - st[2]["utime"];
+            st[0][4] += after["stime"] - st[2]["stime"];
+        }
+    }
+#endif
+    return ret;
+}
+// --------------------------------------------------------------------------
+/// @brief query_apply_stats
+/// @Returns copy of apply_stats
+// --------------------------------------------------------------------------
+public mapping query_apply_stats(void)
+{
+    if(!root_caller("query_apply_stats"))
+        return 0;
+    return copy(apply_stats);
+}
+// --------------------------------------------------------------------------
+/// @brief write_apply_stats
+///
+/// replaces APPLY_STAT_LOG with the current apply_stats
+/// @Returns -
+// --------------------------------------------------------------------------
+private void write_apply_stats(void)
+{
+    string out;
+
+    out  = sprintf("%s\n%-16s %10s %12s %8s %10s %10s\n", ctime(time()),
+            "apply", "calls", "eval cost", "timed", "utime", "stime");
+    foreach(string apply in sort_array(keys(apply_stats), 1))
+    {
+        mixed *stat = apply_stats[apply];
+
+        out += sprintf("%-16s %10d %12d %8d %10d %10d\n", apply,
+                stat[0], stat[1], stat[2], stat[3], stat[4]);
+    }
+    write_file(APPLY_STAT_LOG, out, 1);
+}
+// --------------------------------------------------------------------------
+/// @brief parse_acl_line
+///
+/// parses a single line of Read.acl/Write.acl
+/// @Param ret - acl mapping being built
+/// @Param path - path entry the line belongs to ("" if none yet)
+/// @Param line
+/// @Returns path entry following lines belong to, 0 if line is malformed
+// --------------------------------------------------------------------------
+private string parse_acl_line(mapping ret, string path, string line)
+{
+    string *entries;
+
+    if(!line || (line == "") || (line[0] == '#'))   // skip empty lines and comments
+        return path;
+    switch(line[0])
+    {
+        case '/':                                   // new path entry
+            return line;
+        case '\t':                                  // new function entry
+            if(path == "")                          // malformed config file
+                return 0;
+            entries = explode(trim(line), " ");
+            if(!ret[path])
+                ret[path] = ([]);
+            ret[path][entries[0]] = entries[1..];
+            return path;
+    }
+    return 0;
+}
 private mapping init_acl(string type)
 {
     string  cfg = "",
@@ -196,29 +450,11 @@ private mapping init_acl(string type)
 
         foreach(string line in explode(cfg, "\n"))
         {
-            string *entries = ({});
             ln++;
-            if(!line || (line == "") || (line[0] == '#'))   // skip empty lines and comments
-                continue;
-            switch(line[0])
+            if(!(path = parse_acl_line(ret, path, line)))
             {
-                case '/':                                   // new path entry
-                    path = line;
-                    break;
-                case '\t':                                  // new function entry
-                    if(path == "")                          // malformed config file
-                    {
-                        syslog(LOG_KERN|LOG_WARNING, "malformed config file: %s[%d]", fn, ln);
-                        return ({});
-                    }
-                    entries = explode(trim(line), " ");
-                    if(!ret[path])
-                        ret[path] = ([]);
-                    ret[path][entries[0]] = entries[1..];
-                    break;
-                default:
-                    syslog(LOG_KERN|LOG_WARNING, "malformed config file: %s[%d]", fn, ln);
-                    return ({});
+                syslog(LOG_KERN|LOG_WARNING, "malformed config file: %s[%d]", fn, ln);
+                return ([]);
             }
         }
     }
@@ -227,27 +463,294 @@ private mapping init_acl(string type)
 
     return ret;
 }
-private string *acl(int request, mixed info)
+// --------------------------------------------------------------------------
+/// @brief acl_principals
+/// @Param list - principals (uids, gids and UPRIV_*) from the config file
+/// @Returns ({ UPRIV_* bitmask, ([ "uid": 1, ..., "gid": 1, ... ]) })
+// --------------------------------------------------------------------------
+private mixed *acl_principals(string *list)
 {
-    mapping acl_list;
-    mixed   ret;
+    mapping set  = ([]);
+    int     mask = 0;
+
+    foreach(string principal in list)
+    {
+        if(!undefinedp(upriv_bits[principal]))
+            mask |= UPRIV_MASK(upriv_bits[principal]);
+        else
+            set[principal] = 1;
+    }
+    return ({ mask, set });
+}
+// --------------------------------------------------------------------------
+/// @brief acl_trie_insert
+///
+/// adds the acl entry of a single path to a compiled acl trie, paths ending
+/// in '/' are stored as ACL_NODE_DIR, everything else as ACL_NODE_SELF
+/// @Param trie - root node
+/// @Param path - path as given in the config file
+/// @Param entry - ([ "function" : ({ "uid", ..., "gid", ... }), ... ])
+// --------------------------------------------------------------------------
+private void acl_trie_insert(mapping trie, string path, mapping entry)
+{
+    mapping node     = trie,
+            compiled = ([]);
+
+    path = trim(path);
+    if(path[<1] != '/')
+        acl_exact[path] = 1;
+    foreach(string comp in explode(path, "/") - ({ "" }))
+    {
+        if(!node[comp])
+            node[comp] = ([]);
+        node = node[comp];
+    }
+
+    foreach(string func, string *list in entry)
+        compiled[func] = acl_principals(list);
+    node[(path[<1] == '/') ? ACL_NODE_DIR : ACL_NODE_SELF] = compiled;
+}
+// --------------------------------------------------------------------------
+/// @brief acl_trie_remove
+/// @Param trie - root node
+/// @Param path - path as given in the config file
+// --------------------------------------------------------------------------
+private void acl_trie_remove(mapping trie, string path)
+{
+    mapping node = trie;
+
+    path = trim(path);
+    foreach(string comp in explode(path, "/") - ({ "" }))
+    {
+        if(!(node = node[comp]))
+            return;
+    }
+    map_delete(node, (path[<1] == '/') ? ACL_NODE_DIR : ACL_NODE_SELF);
+}
+// --------------------------------------------------------------------------
+/// @brief compile_acl
+/// @Param acl_list - either acl_read or acl_write
+/// @Returns path-component trie for acl_lookup
+// --------------------------------------------------------------------------
+private mapping compile_acl(mapping acl_list)
+{
+    mapping ret = ([]);
+
+    if(mapp(acl_list))
+        foreach(string path, mapping entry in acl_list)
+            acl_trie_insert(ret, path, entry);
+    return ret;
+}
+// --------------------------------------------------------------------------
+/// @brief acl_lookup
+///
+/// same semantics as match_path on the uncompiled acl: "/some/path/file" is
+/// looked up as "/", "/some/", "/some/path/" and "/some/path/file", the last
+/// existing entry wins. So "/some/path/" applies to everything below
+/// "/some/path" while "/some/path" only applies to itself (and "/some/path/"
+/// only to everything below, not to itself).
+/// @Param trie - compiled acl
+/// @Param path - absolute path
+/// @Returns ([ "function" : ({ UPRIV_* mask, ([ principal : 1, ... ]) }), ... ]) or 0
+// --------------------------------------------------------------------------
+private mapping acl_lookup(mapping trie, string path)
+{
+    mapping  node = trie,
+             ret  = trie[ACL_NODE_DIR];     // "/" covers everything
+    string  *comp = explode(path, "/") - ({ "" });
+    int      sz   = sizeof(comp),
+             dir  = (path[<1] == '/');
+
+    for(int i = 0; i < sz; i++)
+    {
+        mapping entry;
+
+        if(!(node = node[comp[i]]))
+            break;
+        // inner components are only tried as "/.../comp/", the last one
+        // either as "/.../comp/" or as "/.../comp", depending on path
+        if((i < sz - 1) || dir)
+            entry = node[ACL_NODE_DIR];
+        else
+            entry = node[ACL_NODE_SELF];
+        if(entry)
+            ret = entry;
+    }
+    return ret;
+}
+private mixed *acl(int request, mixed info)
+{
+    mapping trie,
+            ret;
 
     switch(request)
     {
         case _READ:
-            acl_list = acl_read;
+            trie = acl_trie_read;
             break;
         case _WRITE:
-            acl_list = acl_write;
+            trie = acl_trie_write;
             break;
         default:
             syslog(LOG_KERN|LOG_INFO, "master::acl(%d,...): unknown request type!", request);
-            return ({});
+            return 0;
     }
-    ret = match_path(acl_list, info[0]);
+    if(!(ret = acl_lookup(trie, info[0])))
+        return 0;
     return ret[info[1]];
 }
 // --------------------------------------------------------------------------
+/// @brief acl_func_name
+///
+/// maps driver supplied function names onto the ones used in the acls
+/// @Param func - function name as given to valid_read/valid_write
+/// @Returns normalized function name
+// --------------------------------------------------------------------------
+private string acl_func_name(string func)
+{
+    switch(func)
+    {
+        case "compress_file":
+        case "ed_start":
+        case "include":
+        case "move_file":
+        case "read_bytes":
+        case "read_file":
+        case "rename":
+        case "write_bytes":
+        case "write_file":
+            return "driver_open";
+        case "get_dir":
+        case "mkdir":
+        case "remove_file":
+        case "rmdir":
+            return "driver_dopen";
+        case "file_size":
+        case "stat":
+            return "driver_stat";
+        case "debug_malloc":
+        case "dumpallobj":
+            return "driver_debug";
+
+        case "load_object":
+        case "restore_object":
+        case "save_object":
+        default:
+            return func;
+    }
+}
+// --------------------------------------------------------------------------
+/// @brief acl_cache_dir
+///
+/// Decisions are cached where ownership is (see sefun::ownership_key),
+/// paths with an acl entry of their own are cached per path.
+/// @Param path - absolute path
+/// @Returns path or directory to be used within the cache key, 0 if the
+///          decision mustn't be cached (tmpd owned paths)
+// --------------------------------------------------------------------------
+private string acl_cache_dir(string path)
+{
+    if(acl_exact[path])
+        return path;
+    return ownership_key(path);
+}
+// --------------------------------------------------------------------------
+/// @brief acl_decision
+///
+/// the uncached part of check_acl
+/// @Param request - _READ or _WRITE
+/// @Param euid
+/// @Param egid
+/// @Param info - ({ path, normalized function name })
+/// @Param ti - this_interactive() at the time of the request
+/// @Returns TRUE if the access is granted, FALSE otherwise
+// --------------------------------------------------------------------------
+private int acl_decision(int request, string euid, string egid, mixed info, object ti)
+{
+    mixed  *access; // ({ UPRIV_* mask, ([ uid/gid: 1 ]) }) for given file
+    string  domain; // domain of the requested path
+    int     mask;   // UPRIV_* granted for this request
+
+    // get the acl for the given path and request
+    if(!(access = acl(request, info)))
+        return FALSE;                           // oops! nobody allowed!
+
+    // test if either user or group is allowed
+    if(access[1][euid] || access[1][egid])
+        return TRUE;
+    if(!access[0])
+        return FALSE;
+
+    mask = UPRIV_MASK(UPRIV_B_ALL);
+
+    // check if owner
+    if((access[0] & UPRIV_MASK(UPRIV_B_AUTHOR)) && (author_file(info[0]) == euid))
+        mask |= UPRIV_MASK(UPRIV_B_AUTHOR);
+
+    // check if domain
+    if(access[0] & (UPRIV_MASK(UPRIV_B_DOMAIN) | UPRIV_MASK(UPRIV_B_D_WIZ) | UPRIV_MASK(UPRIV_B_D_LORD)))
+    {
+        domain = domain_file(info[0]);
+        if(domain == egid)
+            mask |= UPRIV_MASK(UPRIV_B_DOMAIN);
+    }
+
+    // check interactives
+    if(ti)
+        mask |= upriv_mask(ti, domain);
+
+    return (access[0] & mask) != 0;
+}
+// --------------------------------------------------------------------------
+/// @brief upriv_mask
+///
+/// UPRIV_* granted to an interactive, players get their masks from
+/// MUD_INFO_D (pushed via set_upriv_mask, fetched once if still unknown)
+/// @Param ti - this_interactive()
+/// @Param domain - domain of the requested path (may be 0)
+/// @Returns bitmask
+// --------------------------------------------------------------------------
+private int upriv_mask(object ti, string domain)
+{
+    mixed  *entry;
+    string  uid;
+    int     ret = UPRIV_MASK(UPRIV_B_MORTAL);
+
+    if(!playerp(ti))
+        return ret;
+
+    uid = getuid(ti);
+    if(!(entry = upriv_masks[uid]))
+        entry = upriv_masks[uid] = (mixed *)MUD_INFO_D->query_upriv_mask(uid);
+
+    ret |= entry[0];
+    if(domain && entry[1][domain])
+        ret |= entry[1][domain];
+    return ret;
+}
+// --------------------------------------------------------------------------
+/// @brief set_upriv_mask
+///
+/// called by MUD_INFO_D whenever the groups or domains of uid change
+/// @Param uid
+/// @Param mask - UPRIV_* granted regardless of domain
+/// @Param domains - ([ "domain" : UPRIV_* granted within domain, ... ])
+/// @Returns -
+// --------------------------------------------------------------------------
+public void set_upriv_mask(string uid, int mask, mapping domains)
+{
+    object po = PO();
+
+    if(base_name(po) != MUD_INFO_D)
+    {
+        syslog(LOG_AUTH|LOG_ERR, "Privilege violation: master::set_upriv_mask by %O[%s]",
+                po, efun::geteuid(po));
+        return;
+    }
+    upriv_masks[uid] = ({ mask, domains });
+    acl_generation++;                           // cached decisions are void
+}
+// --------------------------------------------------------------------------
 // request currently supported:
 // - _READ
 // - _WRITE
@@ -256,13 +759,16 @@ private string *acl(int request, mixed info)
 // the contents of info depends on the request, refer to the apropriate
 // valid_*
 // returns TRUE if the access is granted, FALSE otherwise
+//
+// decisions are cached per (request, euid, egid, interactive, directory,
+// function) until acl_generation changes, except for tmpd owned paths
 // --------------------------------------------------------------------------
 public int check_acl(int request, string euid, string egid, mixed info)
 {
-    string *access, // access control list for given file
-            author, // author
-            domain; // and domain of the requested path
     object  ti;
+    string  key,
+            dir;
+    mixed   ret;
 
     switch(request) // check for valid request
     {
@@ -272,39 +778,7 @@ public int check_acl(int request, string euid, string egid, mixed info)
                 (sizeof(info) == 2) &&
                 stringp(info[0]) && stringp(info[1]))
             {
-                switch(info[1])                 // map driver supplied function names
-                {
-                    case "compress_file":
-                    case "ed_start":
-                    case "include":
-                    case "move_file":
-                    case "read_bytes":
-                    case "read_file":
-                    case "rename":
-                    case "write_bytes":
-                    case "write_file":
-                        info[1] = "driver_open";
-                        break;
-                    case "get_dir":
-                    case "mkdir":
-                    case "remove_file":
-                    case "rmdir":
-                        info[1] = "driver_dopen";
-                        break;
-                    case "file_size":
-                    case "stat":
-                        info[1] = "driver_stat";
-                        break;
-                    case "debug_malloc":
-                    case "dumpallobj":
-                        info[1] = "driver_debug";
-
-                    case "load_object":
-                    case "restore_object":
-                    case "save_object":
-                    default:
-                        break;
-                }
+                info[1] = acl_func_name(info[1]);
                 break;
             }
             else                                // incorrect parameter
@@ -313,49 +787,273 @@ public int check_acl(int request, string euid, string egid, mixed info)
             return FALSE;
     }
 
-    // get the acl for the given path and request
-    if(!sizeof(access = acl(request, info)))
-        return FALSE;                           // oops! nobody allowed!
+    // acls or memberships changed since the cache was filled?
+    if(acl_cache_gen != acl_generation)
+    {
+        acl_cache     = ([]);
+        acl_cache_gen = acl_generation;
+    }
 
-    // everyone allowed?
-    if(member_array(UPRIV_ALL, access) >= 0)
-        return TRUE;
+    ti  = TI();
+    if(!(dir = acl_cache_dir(info[0])))         // not cacheable
+        return acl_decision(request, euid, egid, info, ti);
+    key = sprintf("%d\t%s\t%s\t%s\t%s\t%s", request, euid, egid,
+            (ti ? efun::getuid(ti) : ""), dir, info[1]);
+    if(!undefinedp(ret = acl_cache[key]))
+    {
+        acl_cache_hits++;
+        return ret;
+    }
+    acl_cache_misses++;
 
-    // test if either user or group is allowed
-    if((member_array(euid, access) >= 0) || (member_array(egid, access) >= 0))
-        return TRUE;
+    ret = acl_decision(request, euid, egid, info, ti);
 
-    // check if owner
-    author = author_file(info[0]);
-    if((member_array(UPRIV_AUTHOR, access) >= 0) && (author == euid))
-        return TRUE;
+    if(sizeof(acl_cache) >= ACL_CACHE_SIZE)     // keep it bounded
+        acl_cache = ([]);
+    acl_cache[key] = ret;
+    return ret;
+}
+// --------------------------------------------------------------------------
+/// @brief check_acl_many
+///
+/// batch version of check_acl for directory listings and globbing, paths
+/// sharing the same acl_cache_dir (usually the same directory) are
+/// authorized only once
+/// @Param request - _READ or _WRITE
+/// @Param euid - effective uid of the object doing the request
+/// @Param egid - effective gid of the object doing the request
+/// @Param func - function name as given to valid_read/valid_write
+/// @Param paths - absolute paths
+/// @Returns those paths access is granted for (in the given order)
+// --------------------------------------------------------------------------
+public string *check_acl_many(int request, string euid, string egid, string func, string *paths)
+{
+    mapping  granted = ([]);
+    string  *ret;
+    int      n;
 
-    // check if domain
-    domain = author_file(info[0]);
-    if((member_array(UPRIV_DOMAIN, access) >= 0) && (domain == egid))
-        return TRUE;
+    if(((request != _READ) && (request != _WRITE)) || !stringp(func) || !pointerp(paths))
+        return ({});
 
-    // check interactives
-    if(ti = TI())
+    func = acl_func_name(func);
+    ret  = allocate(sizeof(paths));
+    foreach(string path in paths)
     {
-        if(member_array(UPRIV_MORTAL, access) >= 0)
-            return TRUE;
-        if((member_array(UPRIV_ELDER, access) >= 0) && elderp(ti))
-            return TRUE;
-        if((member_array(UPRIV_WIZARD, access) >= 0) && creatorp(ti))
-            return TRUE;
-        if((member_array(UPRIV_D_WIZ, access) >= 0) && Dcreatorp(ti, domain))
-            return TRUE;
-        if((member_array(UPRIV_D_LORD, access) >= 0) && Dlordp(ti, domain))
-            return TRUE;
-        if((member_array(UPRIV_ARCH, access) >= 0) && archp(ti))
-            return TRUE;
-        if((member_array(UPRIV_ADMIN, access) >= 0) && adminp(ti))
-            return TRUE;
+        string dir;
+
+        if(!stringp(path))
+            continue;
+        dir = acl_cache_dir(path) || path;
+        if(undefinedp(granted[dir]))
+            granted[dir] = check_acl(request, euid, egid, ({ path, func }));
+        if(granted[dir])
+            ret[n++] = path;
     }
+    return ret[0..n-1];
+}
+// --------------------------------------------------------------------------
+/// @brief set_member_groups
+///
+/// called by MUD_INFO_D whenever the groups of uid change
+/// @Param uid
+/// @Param groups - UPRIV_* uid is member of
+/// @Returns -
+// --------------------------------------------------------------------------
+public void set_member_groups(string uid, string *groups)
+{
+    object po = PO();
 
-    // everything else is disallowed
-    return FALSE;
+    if(base_name(po) != MUD_INFO_D)
+    {
+        syslog(LOG_AUTH|LOG_ERR, "Privilege violation: master::set_member_groups by %O[%s]",
+                po, efun::geteuid(po));
+        return;
+    }
+    if(sizeof(groups))
+        member_groups[uid] = mkmapping(groups, allocate(sizeof(groups), 1));
+    else
+        member_groups[uid] = ([]);
+}
+// --------------------------------------------------------------------------
+/// @brief member_of_group
+///
+/// groups unknown so far are fetched once from MUD_INFO_D, afterwards it's
+/// kept current by set_member_groups
+/// @Param uid
+/// @Param group
+/// @Returns TRUE if uid is member of group
+// --------------------------------------------------------------------------
+private int member_of_group(string uid, string group)
+{
+    mapping grps;
+
+    if(!(grps = member_groups[uid]))
+    {
+        string *list = (string *)MUD_INFO_D->get_groups(uid) || ({});
+
+        grps = member_groups[uid] = mkmapping(list, allocate(sizeof(list), 1));
+    }
+    return grps[group];
+}
+// --------------------------------------------------------------------------
+/// @brief split_id
+/// @Param id - "uid:gid"
+/// @Returns ({ "uid", "gid" }), shared between calls so never modify it!
+// --------------------------------------------------------------------------
+private string *split_id(string id)
+{
+    string *ret;
+
+    if(ret = id_split[id])
+        return ret;
+    if(sizeof(id_split) >= ID_SPLIT_SIZE)
+        id_split = ([]);
+    ret = explode(id, ":");
+    if(sizeof(ret) < 2)                         // malformed, never matches a group
+        ret = ({ sizeof(ret) ? ret[0] : "", "" });
+    return id_split[id] = ret;
+}
+// --------------------------------------------------------------------------
+/// @brief invalidate_acl_cache
+///
+/// voids all cached decisions, membership changes are already covered by
+/// set_upriv_mask
+/// @Returns -
+// --------------------------------------------------------------------------
+public void invalidate_acl_cache(void)
+{
+    if((base_name(PO()) != MUD_INFO_D) && !root_caller("invalidate_acl_cache"))
+        return;
+    acl_generation++;
+}
+// --------------------------------------------------------------------------
+/// @brief query_acl_cache_stats
+/// @Returns ([ "hits": #, "misses": #, "size": #, "generation": # ])
+// --------------------------------------------------------------------------
+public mapping query_acl_cache_stats(void)
+{
+    if(!root_caller("query_acl_cache_stats"))
+        return 0;
+    return ([
+            "hits":       acl_cache_hits,
+            "misses":     acl_cache_misses,
+            "size":       sizeof(acl_cache),
+            "generation": acl_generation,
+            ]);
+}
+// --------------------------------------------------------------------------
+/// @brief acl_same
+///
+/// compares an uncompiled acl entry (as returned by match_path) with a
+/// compiled one (as returned by acl_lookup)
+/// @Param raw - ([ "function" : ({ "uid", ..., "gid", ... }), ... ]) or 0
+/// @Param compiled - ([ "function" : ({ mask, ([ principal : 1 ]) }), ... ]) or 0
+/// @Returns 1 if both grant the same, 0 otherwise
+// --------------------------------------------------------------------------
+private int acl_same(mapping raw, mapping compiled)
+{
+    if(!raw || !compiled)
+        return !raw && !compiled;
+    if(sizeof(raw) != sizeof(compiled))
+        return 0;
+    foreach(string func, string *list in raw)
+    {
+        mixed *c = compiled[func],
+              *r = acl_principals(list);
+
+        if(!c || (c[0] != r[0]) ||
+                (implode(sort_array(keys(c[1]), 1), ",") !=
+                 implode(sort_array(keys(r[1]), 1), ",")))
+            return 0;
+    }
+    return 1;
+}
+// --------------------------------------------------------------------------
+/// @brief benchmark_acl
+///
+/// compares the compiled acl lookup against the former match_path based one
+/// for every configured read path, the path with or without a trailing '/'
+/// and a deep path below each of them. Besides the timings every path is
+/// checked to be resolved to the same entry by both.
+/// @Param rounds - how often each path is looked up
+/// @Returns ([ "paths": #paths, "match_path": usec, "trie": usec,
+///             "mismatches": ({ path, ... }) ])
+// --------------------------------------------------------------------------
+public mapping benchmark_acl(int rounds)
+{
+    string *paths = ({}),
+           *mismatches = ({});
+    int     t_match,
+            t_trie;
+
+    if(!root_caller("benchmark_acl"))
+        return 0;
+
+    foreach(string path in keys(acl_read))
+    {
+        path   = trim(path);
+        paths += ({ path, path + "a/b/c/d/e/file.c" });
+        if(path[<1] == '/')
+            paths += ({ path[0..<2] });
+        else
+            paths += ({ path + "/", path + "/file.c" });
+    }
+    paths = filter(paths, (: sizeof($1) && ($1[0] == '/') :));
+
+    foreach(string path in paths)
+        if(!acl_same(match_path(acl_read, path), acl_lookup(acl_trie_read, path)))
+            mismatches += ({ path });
+
+    t_match = time_expression
+    {
+        for(int r = 0; r < rounds; r++)
+            foreach(string path in paths)
+            {
+                mapping entry = match_path(acl_read, path);
+
+                if(entry && entry["driver_open"])
+                    member_array(UPRIV_ADMIN, entry["driver_open"]);
+            }
+    };
+    t_trie = time_expression
+    {
+        for(int r = 0; r < rounds; r++)
+            foreach(string path in paths)
+            {
+                mapping entry = acl_lookup(acl_trie_read, path);
+
+                if(entry && entry["driver_open"])
+                    entry["driver_open"][0] & UPRIV_MASK(UPRIV_B_ADMIN);
+            }
+    };
+
+    return ([
+            "paths":      sizeof(paths),
+            "match_path": t_match,
+            "trie":       t_trie,
+            "mismatches": mismatches,
+            ]);
+}
+// --------------------------------------------------------------------------
+/// @brief parse_privs_line
+///
+/// parses a single line of Privs.cfg
+/// @Param ret - privileges mapping being built
+/// @Param line
+/// @Returns FALSE if line is malformed, TRUE otherwise
+// --------------------------------------------------------------------------
+private int parse_privs_line(mapping ret, string line)
+{
+    string *t;
+
+    if(!line || (line == "") || (line[0] == '#'))   // skip empty lines and comments
+        return TRUE;
+    if(line[0] != '/')
+        return FALSE;
+
+    t = explode(line, "\t");
+    ret[t[0]] = t[1];
+    return TRUE;
 }
 private mapping init_privileges(void)
 {
@@ -374,14 +1072,7 @@ private mapping init_privileges(void)
         foreach(string line in explode(cfg, "\n"))
         {
             ln++;
-            if(!line || (line == "") || (line[0] == '#'))   // skip empty lines and comments
-                continue;
-            else if(line[0] == '/')
-            {
-                string *t = explode(line, "\t")
-                ret[t[0]] = t[1];
-            }
-            else
+            if(!parse_privs_line(ret, line))
                 syslog(LOG_KERN|LOG_WARNING, "malformed config file: " + PRIVS_CFG + "[%d]", ln);
         }
     }
@@ -390,7 +1081,175 @@ private mapping init_privileges(void)
 
     return ret;
 }
+// --------------------------------------------------------------------------
+/// @brief reload_config
+///
+/// Rereads one of the config files without reloading the master. The file
+/// is parsed in slices of CFG_RELOAD_LINES lines, one call_out each, and
+/// only when it is completely parsed the changed path entries are swapped
+/// into the live mappings (see apply_reload).
+/// @Param type - "r": Read.acl, "w": Write.acl, "p": Privs.cfg
+/// @Returns TRUE if the reload was started
+// --------------------------------------------------------------------------
+public int reload_config(string type)
+{
+    string  fn;
+    mixed  *st;
+
+    if(!root_caller("reload_config"))
+        return FALSE;
+
+    switch(type)
+    {
+        case "r":
+            fn = ACL_READ_CFG;
+            break;
+        case "w":
+            fn = ACL_WRITE_CFG;
+            break;
+        case "p":
+            fn = PRIVS_CFG;
+            break;
+        default:
+            return FALSE;
+    }
 
+    if(cfg_reloads[type])                       // already running
+        return FALSE;
+    if(!pointerp(st = stat(fn)) || (sizeof(st) < 2))
+    {
+        syslog(LOG_KERN|LOG_WARNING, "master::reload_config: can't stat %s", fn);
+        return FALSE;
+    }
+
+    cfg_reloads[type] = ([
+            "file":  fn,
+            "mtime": st[1],
+            "line":  1,
+            "path":  "",
+            "data":  ([]),
+            ]);
+    call_out( (: reload_slice :), 0, type);
+    return TRUE;
+}
+// --------------------------------------------------------------------------
+/// @brief reload_slice
+///
+/// parses the next CFG_RELOAD_LINES lines of a running reload
+/// @Param type - see reload_config
+/// @Returns -
+// --------------------------------------------------------------------------
+private void reload_slice(string type)
+{
+    mapping  state = cfg_reloads[type];
+    string   chunk;
+    mixed   *st;
+    int      ln;
+
+    if(!state)
+        return;
+
+    // the file must not change while we're reading it
+    st = stat(state["file"]);
+    if(!pointerp(st) || (sizeof(st) < 2) || (st[1] != state["mtime"]))
+    {
+        syslog(LOG_KERN|LOG_WARNING, "master::reload_config: %s changed while reloading, aborted", state["file"]);
+        map_delete(cfg_reloads, type);
+        return;
+    }
+
+    // end of file reached?
+    if(!(chunk = read_file(state["file"], state["line"], CFG_RELOAD_LINES)))
+    {
+        map_delete(cfg_reloads, type);
+        apply_reload(type, state["file"], state["data"]);
+        return;
+    }
+
+    ln = state["line"];
+    foreach(string line in explode(chunk, "\n"))
+    {
+        int ok;
+
+        if(type == "p")
+            ok = parse_privs_line(state["data"], line);
+        else
+            ok = !!(state["path"] = parse_acl_line(state["data"], state["path"], line));
+        if(!ok)
+        {
+            syslog(LOG_KERN|LOG_WARNING, "malformed config file: %s[%d], reload aborted", state["file"], ln);
+            map_delete(cfg_reloads, type);
+            return;
+        }
+        ln++;
+    }
+
+    state["line"] += CFG_RELOAD_LINES;
+    call_out( (: reload_slice :), 0, type);
+}
+// --------------------------------------------------------------------------
+/// @brief apply_reload
+///
+/// swaps the changed path entries of a completely parsed config file into
+/// the live mappings (and tries), all within one evaluation
+/// @Param type - see reload_config
+/// @Param fn - config file (for logging)
+/// @Param data - parsed config file
+/// @Returns -
+// --------------------------------------------------------------------------
+private void apply_reload(string type, string fn, mapping data)
+{
+    mapping live,
+            trie;
+    int     changed,
+            removed;
+
+    switch(type)
+    {
+        case "r":
+            live = acl_read;
+            trie = acl_trie_read;
+            break;
+        case "w":
+            live = acl_write;
+            trie = acl_trie_write;
+            break;
+        case "p":
+            live = privileges;
+            break;
+    }
+
+    foreach(string path, mixed entry in data)
+    {
+        if(cmp(live[path], entry))
+            continue;
+        live[path] = entry;
+        if(trie)
+            acl_trie_insert(trie, path, entry);
+        changed++;
+    }
+    foreach(string path in keys(live) - keys(data))
+    {
+        map_delete(live, path);
+        if(trie)
+            acl_trie_remove(trie, path);
+        removed++;
+    }
+
+    if(trie && (changed || removed))
+    {
+        acl_exact = ([]);
+        foreach(string path in keys(acl_read) + keys(acl_write))
+            if((path = trim(path))[<1] != '/')
+                acl_exact[path] = 1;
+        acl_generation++;                       // cached decisions are void
+    }
+    if(changed || removed)
+        save_master();
+
+    syslog(LOG_KERN|LOG_NOTICE, "master::reload_config: %s reloaded, %d changed, %d removed",
+            fn, changed, removed);
+}
 private void startup_summary(void)
 {
     string out;
@@ -492,9 +1351,13 @@ private string *epilog(int dummy)
             // include all "*.c" from directories
             if(line[<1] == '/')
             {
-                foreach(string entry in get_dir(line + "*.c"))
+                foreach(mixed *file in get_dir_listing(line) || ({}))
                 {
-                    entry = entry[0..<3];       // cut of '.c' file ending
+                    string entry = file[0];
+
+                    if(file[1] || (entry[<2..] != ".c"))
+                        continue;
+                    entry = line + entry[0..<3];    // cut of '.c' file ending
                     if(!seen[entry])
                     {
                         ret += ({ entry });
@@ -610,7 +1473,15 @@ private void crash(string crash_message, object command_giver, object current_ob
 {
     object *usr = users();
 
-    syslog(LOG_KERN|LOG_EMERG, "master::crash(\"%s\", %O, %O)", crsh_message, commmd_giver, current_object);
+    syslog(LOG_KERN|LOG_EMERG, "master::crash(\"%s\", %O, %O)", crash_message, command_giver, current_object);
+
+    // recent log context for the post-mortem and everything still buffered
+    // (including the line above), before anything else may fail
+    if(find_object(SYSLOG_D))
+    {
+        SYSLOG_D->dump_recent("crash: " + crash_message);
+        SYSLOG_D->flush();
+    }
 
     // inform the player
     reset_eval_cost();                  // we might need to do a lot of calls...
@@ -622,7 +1493,7 @@ private void crash(string crash_message, object command_giver, object current_ob
 
     // terminate daemons and other secure objects gracefully
     reset_eval_cost();                  // we might need to do a lot of calls...
-    event(objects( (: file_name($1)[0..8] == "/secure/" :) ), "shutdown");
+    event(objects( (: file_name($1)[0..7] == "/secure/" :) ), "shutdown");
 }
 ///  @}
 
@@ -714,6 +1585,12 @@ private string domain_file(string file)
 /// @Returns name of creator
 // --------------------------------------------------------------------------
 private string creator_file(string filename)
+{
+    mixed *st = apply_enter("creator_file");
+
+    return apply_leave(st, _creator_file(filename));
+}
+private string _creator_file(string filename)
 {
     return("%s:%s",
             author_of(filename),
@@ -841,6 +1718,12 @@ private int valid_link(string from, string to)
 /// @Returns
 // --------------------------------------------------------------------------
 private int valid_object(object ob)
+{
+    mixed *st = apply_enter("valid_object");
+
+    return apply_leave(st, _valid_object(ob));
+}
+private int _valid_object(object ob)
 {
     string file;
     int    clone,
@@ -921,6 +1804,12 @@ private int valid_object(object ob)
 /// @Returns
 // --------------------------------------------------------------------------
 private int valid_override(string file, string efun_name, string mainfile)
+{
+    mixed *st = apply_enter("valid_override");
+
+    return apply_leave(st, _valid_override(file, efun_name, mainfile));
+}
+private int _valid_override(string file, string efun_name, string mainfile)
 {
     // we don't have an object yet!!!
     // only the filename from which the object is compiled...
@@ -948,6 +1837,12 @@ private int valid_override(string file, string efun_name, string mainfile)
 /// @Returns
 // --------------------------------------------------------------------------
 public int valid_read(string file, object ob, string func)
+{
+    mixed *st = apply_enter("valid_read");
+
+    return apply_leave(st, _valid_read(file, ob, func, origin() == ORIGIN_DIVER));
+}
+private int _valid_read(string file, object ob, string func, int driver)
 {
     string euid,
            egid;
@@ -961,7 +1856,7 @@ public int valid_read(string file, object ob, string func)
         return TRUE;
 
     // everything else fails
-    if(origin() == ORIGIN_DIVER)        // log only for actual requets
+    if(driver)                          // log only for actual requets
         syslog(LOG_AUTH|LOG_ERR,
                 "Privilege violation: valid_read(\"%s\", %O[%s:%s], \"%s\")",
                 file, ob, euid, egid, func);
@@ -980,9 +1875,14 @@ public int valid_read(string file, object ob, string func)
 /// @Attention this function checks driver internal representations!!!
 // --------------------------------------------------------------------------
 private int valid_seteuid(object ob, string t_euid)
+{
+    mixed *st = apply_enter("valid_seteuid");
+
+    return apply_leave(st, _valid_seteuid(ob, t_euid));
+}
+private int _valid_seteuid(object ob, string t_euid)
 {
     string  uid,
-           *uids
             euid,
            *euids,
            *t_euids;
@@ -999,12 +1899,11 @@ private int valid_seteuid(object ob, string t_euid)
     if((!euid || test_bit(query_privs(ob), PRIV_SETEUID)) && (uid == t_euid))
         return TRUE;
 
-    uids    = explode(uid, ":");
     if(!euid)
         euids = ({ UNKNOWN_UID, UNKNOWN_DOMAIN });
     else
-        euids   = explode(euid, ":");
-    t_euids = explode(t_euid, ":");
+        euids   = split_id(euid);
+    t_euids = split_id(t_euid);
 
     // effective ROOT_UID may change it's euid to any other
     if(euids[0] == ROOT_UID)
@@ -1013,12 +1912,10 @@ private int valid_seteuid(object ob, string t_euid)
     // interactives may change their current group to any they are a member of
     if(ob == TI())
     {
-        if(uids[0] == t_euids[0])
-        {
-            string *grps = MUD_INFO_D->get_groups(uids[0]);
-            if(member_array(t_euids[1], grps) != -1)
-                return TRUE;
-        }
+        string *uids = split_id(uid);
+
+        if((uids[0] == t_euids[0]) && member_of_group(uids[0], t_euids[1]))
+            return TRUE;
         // todo:
         // allow 'su user' with correct credentials
     }
@@ -1096,6 +1993,12 @@ private int valid_shadow(object ob)
 /// @Returns
 // --------------------------------------------------------------------------
 private int valid_socket(object ob, string func, mixed *info)
+{
+    mixed *st = apply_enter("valid_socket");
+
+    return apply_leave(st, _valid_socket(ob, func, info));
+}
+private int _valid_socket(object ob, string func, mixed *info)
 {
     string privs = query_privs(ob);
 
@@ -1140,6 +2043,12 @@ private int valid_socket(object ob, string func, mixed *info)
 /// @Returns
 // --------------------------------------------------------------------------
 public int valid_write(string file, object ob, string func)
+{
+    mixed *st = apply_enter("valid_write");
+
+    return apply_leave(st, _valid_write(file, ob, func, origin() == ORIGIN_DIVER));
+}
+private int _valid_write(string file, object ob, string func, int driver)
 {
     string euid,
            egid;
@@ -1153,7 +2062,7 @@ public int valid_write(string file, object ob, string func)
         return TRUE;
 
     // everything else fails
-    if(origin() == ORIGIN_DIVER)    // log only for actual requets, not some lib-internal stat
+    if(driver)                      // log only for actual requets, not some lib-internal stat
         syslog(LOG_AUTH|LOG_ERR,
                 "Privilege violation: valid_write(\"%s\", %O[%s:%s], \"%s\")",
                 file, ob, euid, egid, func);
@@ -1268,10 +2177,12 @@ private mapping get_mud_stats(void)
 // --------------------------------------------------------------------------
 private void error_handler(mapping err, int caught)
 {
-    string str,
-           ret,
-           author = author_file(err["file"]),
-           domain = domain_file(err["file"]);
+    string  str,
+            key,
+            author,
+            domain;
+    mixed  *entry;
+    int     now = time();
 
     // remove trailing (and leading) whitespace
     err["error"] = trim(err["error"]);
@@ -1280,6 +2191,34 @@ private void error_handler(mapping err, int caught)
     if(err["error"][0..23] == "*Error in loading object")
         return 0;
 
+    // aggregate, only the first occurrence and every ERROR_SAMPLE-th repeat
+    // are rendered and logged
+    key = sprintf("%s:%d:%s", err["file"], err["line"], err["error"]);
+    if(!(entry = error_stats[key]))
+    {
+        if(sizeof(error_stats) >= ERROR_MAX)
+        {
+            // forget the one not seen for the longest time
+            string  oldest;
+            int     t = now + 1;
+
+            foreach(string k, mixed *e in error_stats)
+            {
+                if(e[2] < t)
+                {
+                    t      = e[2];
+                    oldest = k;
+                }
+            }
+            map_delete(error_stats, oldest);
+        }
+        entry = error_stats[key] = ({ 0, now, 0, 0, err["file"], err["line"], err["error"] });
+    }
+    entry[0]++;
+    entry[2] = now;
+    if(caught)
+        entry[3]++;
+
     str = sprintf("Error %:8s : %s\nCurrent object : %O\nCurrent program: %s\nFile           : %s[%05d]\n",
             (caught ? "(caught)" : ""),
             err["error"],
@@ -1287,7 +2226,16 @@ private void error_handler(mapping err, int caught)
             (err["program"] || "<none>"),
             err["file"], err["line"]);
 
-    ret = caught ? "" : str;
+    if((entry[0] > 1) && (entry[0] % ERROR_SAMPLE))
+    {
+        // known error, the one causing it gets to know nevertheless
+        if(!caught && (TI() || TP()))
+            message(MSGCLASS_ERROR, str, TI() || TP(), ({}));
+        return;
+    }
+
+    author = author_file(err["file"]);
+    domain = domain_file(err["file"]);
 
     if(!caught)
     {
@@ -1301,6 +2249,9 @@ private void error_handler(mapping err, int caught)
         message(MSGCLASS_ERROR, str, ob, ({}));
     }
 
+    if(entry[0] > 1)
+        str += sprintf("Occurrences    : %d (%d caught) since %s\n",
+                entry[0], entry[3], ctime(entry[1]));
     str += sprintf("Call trace:\n%s\n",
             implode(map_array(err["trace"],
             (: sprintf("--\nObject: %O\nProgram: %O\nFile: %s[%05d]",
@@ -1308,7 +2259,24 @@ private void error_handler(mapping err, int caught)
                        $1["program"] || "<none>",
                        $1["file"], $1["line"]) :)), "\n"));
 
-    m_syslog(author, domain, LOG_KERN|LOG_ERR, str);
+    m_syslog(author, domain, LOG_KERN|LOG_ERR, "%s", str);
+}
+// --------------------------------------------------------------------------
+/// @brief query_top_errors
+/// @Param n - # of errors wanted
+/// @Returns the n most frequent runtime errors:
+///          ({ ({ count, first seen, last seen, # caught, file, line, error }), ... })
+// --------------------------------------------------------------------------
+public mixed *query_top_errors(int n)
+{
+    mixed *ret;
+
+    if(!root_caller("query_top_errors"))
+        return 0;
+    ret = sort_array(values(error_stats), (: $2[0] - $1[0] :));
+    if((n > 0) && (n < sizeof(ret)))
+        ret = ret[0..n-1];
+    return map_array(ret, (: copy($1) :));
 }
 // --------------------------------------------------------------------------
 /// @brief log_error
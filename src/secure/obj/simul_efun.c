@@ -29,8 +29,11 @@ private void create(void)
 {
     startup_finished = FALSE;
 
-    init_object_efuns();
-    init_terminal_efuns();
+    init_file_system_sefuns();
+    init_logging_sefuns();
+    init_object_sefuns();
+    init_strings_sefuns();
+    init_terminal_sefuns();
     initialize_regex_globbing();
 }
 
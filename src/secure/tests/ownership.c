@@ -0,0 +1,179 @@
+/// @addtogroup privileged
+/// @{
+/// @file ownership.c
+/// @brief pins the semantics of MUD_INFO_D's author_file/domain_file
+///
+/// Every path layout is checked against a table of expected owners and
+/// against the former file_size() based implementation. The directories
+/// the results depend on are created by run() and removed afterwards:
+///
+///     > call /secure/tests/ownership->run()
+///
+/// @version 0.0.0
+/// @date 2026-10-17
+
+#include <pragmas.h>        // setting standard pragmas
+#include <privs.h>          // privlege related defines
+#include <std_paths.h>      // standard paths used by various objects
+
+#define TEST_UID        "ownertest"
+#define TEST_DOMAIN     "OwnerTest"
+#define TEST_PLAYER     "/players/o/" TEST_UID
+#define TEST_DOMAIN_DIR "/Domains/" TEST_DOMAIN
+
+/// directories created for the test, parents first
+#define FIXTURE_DIRS ({ \
+            TEST_PLAYER, \
+            TEST_DOMAIN_DIR, \
+            TEST_DOMAIN_DIR "/members", \
+            TEST_DOMAIN_DIR "/members/" TEST_UID, \
+        })
+
+private int failed;
+
+// --------------------------------------------------------------------------
+/// @brief ref_author
+///
+/// author_file as it was before known_dirs, stat'ing the path
+/// @Param file - absolute path
+/// @Returns expected author
+// --------------------------------------------------------------------------
+private string ref_author(string file)
+{
+    string *path = explode(file, "/");  // path[0] == "" !!!
+    int     sp   = sizeof(path),
+            fs   = file_size(file);
+
+    switch(path[1])
+    {
+        case "players":
+            if((sp > 4) || (sp == 4) && (fs == -2))
+                return path[3];
+            else if(fs == -2)
+                return BB_UID;
+            break;
+        case "Domains":
+            if(((sp >= 5) && (path[3] == "members")) &&
+                ((sp > 5) || ((sp == 5) && (fs == -2))))
+                return path[4];
+            else if((sp > 3) || ((sp == 3) && (fs == -2)))
+                return path[2];
+            else if(fs == -2)
+                return BB_UID;
+            break;
+        case "var":
+            if((sp > 3) && (path[2] == "spool"))
+            {
+                if((sp > 5) && (path[3] == "mail"))
+                    return path[5];
+                else
+                    return BB_UID;
+            }
+    }
+    return UNKNOWN_UID;
+}
+// --------------------------------------------------------------------------
+/// @brief ref_domain
+///
+/// domain_file as it was before known_dirs, stat'ing the path
+/// @Param file - absolute path
+/// @Returns expected domain
+// --------------------------------------------------------------------------
+private string ref_domain(string file)
+{
+    string *path = explode(file, "/");  // path[0] == "" !!!
+    int     sp   = sizeof(path),
+            fs   = file_size(file);
+
+    switch(path[1])
+    {
+        case "players":
+            if((sp > 4) || (sp == 4) && (fs == -2))
+                return MUD_INFO_D->is_wiz(path[3]) ? WIZARD_DOMAIN : PLAYER_DOMAIN;
+            else if(fs == -2)
+                return BB_DOMAIN;
+            break;
+        case "Domains":
+            if((sp > 3) || ((sp == 3) && (fs == -2)))
+                return path[2];
+            else if(sp == 2)
+                return BB_DOMAIN;
+            break;
+    }
+    return UNKNOWN_DOMAIN;
+}
+// --------------------------------------------------------------------------
+/// @brief check
+/// @Param path - absolute path
+/// @Param author - expected author_file(path)
+/// @Param domain - expected domain_file(path)
+/// @Returns -
+// --------------------------------------------------------------------------
+private void check(string path, string author, string domain)
+{
+    string a = MUD_INFO_D->author_file(path),
+           d = MUD_INFO_D->domain_file(path);
+
+    if((a != author) || (a != ref_author(path)))
+    {
+        failed++;
+        write(sprintf("FAIL author_file(%O): %O, expected %O (stat: %O)\n",
+                path, a, author, ref_author(path)));
+    }
+    if((d != domain) || (d != ref_domain(path)))
+    {
+        failed++;
+        write(sprintf("FAIL domain_file(%O): %O, expected %O (stat: %O)\n",
+                path, d, domain, ref_domain(path)));
+    }
+}
+// --------------------------------------------------------------------------
+/// @brief run
+///
+/// creates the fixture directories, checks every layout, removes the
+/// fixtures and checks the same paths again
+/// @Returns number of failed checks
+// --------------------------------------------------------------------------
+public int run(void)
+{
+    string mortal = MUD_INFO_D->is_wiz(TEST_UID) ? WIZARD_DOMAIN : PLAYER_DOMAIN;
+
+    failed = 0;
+
+    foreach(string dir in FIXTURE_DIRS)
+        if((file_size(dir) != -2) && !mkdir(dir))
+            error(sprintf("ownership test: can't create %s", dir));
+
+    // path                                                 author          domain
+    check("/players",                                       BB_UID,         BB_DOMAIN);
+    check("/players/o",                                     BB_UID,         BB_DOMAIN);
+    check(TEST_PLAYER,                                      TEST_UID,       mortal);
+    check(TEST_PLAYER "/workroom.c",                        TEST_UID,       mortal);
+    check(TEST_PLAYER "/a/b/c.c",                           TEST_UID,       mortal);
+    check(TEST_PLAYER ".o",                                 UNKNOWN_UID,    UNKNOWN_DOMAIN);
+    check("/Domains",                                       BB_UID,         BB_DOMAIN);
+    check(TEST_DOMAIN_DIR,                                  TEST_DOMAIN,    TEST_DOMAIN);
+    check(TEST_DOMAIN_DIR ".c",                             UNKNOWN_UID,    UNKNOWN_DOMAIN);
+    check(TEST_DOMAIN_DIR "/room.c",                        TEST_DOMAIN,    TEST_DOMAIN);
+    check(TEST_DOMAIN_DIR "/members",                       TEST_DOMAIN,    TEST_DOMAIN);
+    check(TEST_DOMAIN_DIR "/members/" TEST_UID,             TEST_UID,       TEST_DOMAIN);
+    check(TEST_DOMAIN_DIR "/members/" TEST_UID "/room.c",   TEST_UID,       TEST_DOMAIN);
+    check(TEST_DOMAIN_DIR "/members/nobody.c",              TEST_DOMAIN,    TEST_DOMAIN);
+    check("/var/spool/mail/o/" TEST_UID "/inbox",           TEST_UID,       UNKNOWN_DOMAIN);
+    check("/var/spool/news/board.o",                        BB_UID,         UNKNOWN_DOMAIN);
+    check("/var/log/syslog",                                UNKNOWN_UID,    UNKNOWN_DOMAIN);
+    check("/std/room.c",                                    UNKNOWN_UID,    UNKNOWN_DOMAIN);
+    check("/secure/obj/master.c",                           UNKNOWN_UID,    UNKNOWN_DOMAIN);
+
+    for(int i = sizeof(FIXTURE_DIRS) - 1; i >= 0; i--)
+        rmdir(FIXTURE_DIRS[i]);
+
+    // the same layouts without the directories
+    check(TEST_PLAYER,                                      UNKNOWN_UID,    UNKNOWN_DOMAIN);
+    check(TEST_DOMAIN_DIR,                                  UNKNOWN_UID,    UNKNOWN_DOMAIN);
+    check(TEST_DOMAIN_DIR "/members/" TEST_UID,             TEST_DOMAIN,    TEST_DOMAIN);
+
+    write(sprintf("ownership: %d failed\n", failed));
+    return failed;
+}
+///  @}